@@ -7,5 +7,23 @@ set -x
 ./scripts/check_build.sh
 
 ./temp/build-release/demo_coarse_grained 8 4 100000
+./temp/build-release/demo_flat_combining 8 4 100000
+./temp/build-release/demo_reader_writer 8 4 100000
 ./temp/build-release/demo_striped 8 4 100000
 ./temp/build-release/demo_refinable 8 4 100000
+./temp/build-release/demo_lock_free 8 4 100000
+
+# a read-mostly workload with Zipfian skew
+./temp/build-release/demo_sequential 4 --mix=90:5:5 --dist=zipf
+./temp/build-release/demo_coarse_grained 8 4 --mix=90:5:5 --dist=zipf
+./temp/build-release/demo_flat_combining 8 4 --mix=90:5:5 --dist=zipf
+./temp/build-release/demo_reader_writer 8 4 --mix=90:5:5 --dist=zipf
+./temp/build-release/demo_striped 8 4 --mix=90:5:5 --dist=zipf
+./temp/build-release/demo_refinable 8 4 --mix=90:5:5 --dist=zipf
+./temp/build-release/demo_lock_free 8 4 --mix=90:5:5 --dist=zipf
+
+# throughput of every set against thread count, relative to the sequential set
+./temp/build-release/bench_scaling "$(nproc)" --pin=1 --reps=5 --warmup=1
+
+# single-operation costs of every set, from L1-resident to DRAM-sized
+./temp/build-release/bench_micro
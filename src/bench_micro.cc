@@ -0,0 +1,428 @@
+// Times single operations on every hash set, on one thread, at set sizes
+// chosen to fit in L1, L2 and the last-level cache and to spill to DRAM:
+//
+//   bench_micro [--sets=name,...] [--ops=name,...] [--sizes=N,...]
+//               [--min-time=S] [--reps=N] [--seed=N]
+//               [--format=text|csv|json]
+//
+// The operations are:
+//
+//   add, remove    Add and then Remove a batch of absent keys, timing each
+//                  half, so that the set stays at its size
+//   contains_hit   Contains of present keys, in a random order
+//   contains_miss  Contains of absent keys, in a random order
+//   resize         Reserve(4 * size), which rehashes under every policy, on a
+//                  set just filled to size, timed per element held, as that
+//                  is what a rehash moves. The lock-free set only publishes a
+//                  larger bucket count, splitting buckets lazily as later
+//                  operations reach them
+//
+// Each set starts at capacity 16 and is filled, untimed, with a random
+// permutation of [0, size), so every resize it needs has happened before
+// timing starts; absent keys come from [size, 2 * size), and --sizes gives
+// element counts. Each rep of a case runs until --min-time seconds have been
+// timed, giving up after twenty times that, and the median and fastest time
+// per operation over --reps reps are reported. The harness is in-tree rather
+// than google/benchmark so that the build needs nothing beyond the compiler.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "src/hash_set_coarse_grained.h"
+#include "src/hash_set_flat_combining.h"
+#include "src/hash_set_lock_free.h"
+#include "src/hash_set_prefiltered.h"
+#include "src/hash_set_reader_writer.h"
+#include "src/hash_set_refinable.h"
+#include "src/hash_set_sequential.h"
+#include "src/hash_set_sharded.h"
+#include "src/hash_set_striped.h"
+#include "src/table/flat_table.h"
+#include "src/table/incremental_table.h"
+#include "src/workload.h"
+
+namespace {
+
+using benchmark::ReportFormat;
+using Clock = std::chrono::steady_clock;
+
+struct Size {
+  std::string name;
+  size_t elements;
+};
+
+// Element counts whose sets fit, with their buckets, in a typical 32 KB L1,
+// 1 MB L2 and 32 MB last-level cache, and one that is well beyond them.
+const Size kSizeClasses[] = {
+    {"L1", size_t{1} << 9},
+    {"L2", size_t{1} << 14},
+    {"LLC", size_t{1} << 18},
+    {"DRAM", size_t{1} << 22},
+};
+
+constexpr const char* kOps[] = {"add", "remove", "contains_hit",
+                                "contains_miss", "resize"};
+
+struct Options {
+  std::vector<std::string> sets;  // every set if empty
+  std::vector<std::string> ops;   // every operation if empty
+  std::vector<Size> sizes{std::begin(kSizeClasses), std::end(kSizeClasses)};
+  double min_time = 0.1;
+  size_t reps = 3;
+  uint64_t seed = 1;
+  ReportFormat format = ReportFormat::kText;
+};
+
+// The time per operation of each rep of one case.
+struct Result {
+  std::string set;
+  std::string size;
+  size_t elements;
+  std::string op;
+  std::vector<double> nanos_per_op;
+
+  [[nodiscard]] double Median() const {
+    std::vector<double> sorted = nanos_per_op;
+    std::sort(sorted.begin(), sorted.end());
+    size_t mid = sorted.size() / 2;
+    return sorted.size() % 2 == 1 ? sorted[mid]
+                                  : (sorted[mid - 1] + sorted[mid]) / 2;
+  }
+
+  [[nodiscard]] double Min() const {
+    return *std::min_element(nanos_per_op.begin(), nanos_per_op.end());
+  }
+};
+
+// Accumulates the timed part of a case across batches.
+struct Timer {
+  Clock::duration timed{};
+  size_t ops = 0;
+
+  // Runs |batch|, which returns the number of operations it did, and counts
+  // its time.
+  template <typename Batch>
+  void Time(Batch batch) {
+    auto begin = Clock::now();
+    size_t n = batch();
+    timed += Clock::now() - begin;
+    ops += n;
+  }
+
+  [[nodiscard]] double Seconds() const {
+    return std::chrono::duration<double>(timed).count();
+  }
+
+  [[nodiscard]] double NanosPerOp() const {
+    return ops == 0 ? 0 : Seconds() * 1e9 / static_cast<double>(ops);
+  }
+
+  // Returns true once |min_time| seconds have been timed, or once |deadline|
+  // has passed after at least one batch.
+  [[nodiscard]] bool Done(double min_time, Clock::time_point deadline) const {
+    return Seconds() >= min_time || (ops > 0 && Clock::now() >= deadline);
+  }
+};
+
+bool Selected(const std::vector<std::string>& selected,
+              const std::string& name) {
+  return selected.empty() ||
+         std::find(selected.begin(), selected.end(), name) != selected.end();
+}
+
+/**
+ * Returns a fresh set holding every key of |keys|.
+ */
+template <typename HashSetType>
+std::unique_ptr<HashSetType> Filled(const std::vector<int>& keys) {
+  auto hash_set = std::make_unique<HashSetType>(16);
+  for (int key : keys) hash_set->Add(key);
+  return hash_set;
+}
+
+/**
+ * Runs one rep of |op| on a set of the |present| keys, timing batches until
+ * |min_time| seconds have been timed. |absent| are keys not in the set.
+ * Returns false if the set gives a wrong answer.
+ */
+template <typename HashSetType>
+bool RunRep(const std::string& op, const std::vector<int>& present,
+            const std::vector<int>& absent, double min_time, Timer& timer,
+            std::string& error) {
+  bool correct = true;
+  auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(
+                                         20 * min_time));
+  if (op == "resize") {
+    while (!timer.Done(min_time, deadline)) {
+      auto hash_set = Filled<HashSetType>(present);
+      timer.Time([&] {
+        hash_set->Reserve(4 * present.size());
+        return present.size();
+      });
+      correct = correct && hash_set->Size() == present.size();
+    }
+  } else {
+    auto hash_set = Filled<HashSetType>(present);
+    // batches small enough next to the set not to change its size much, and
+    // long enough to hide the cost of reading the clock
+    size_t batch = std::clamp<size_t>(present.size() / 8, 1, 1024);
+    const auto& queries = op == "contains_hit" ? present : absent;
+    // an untimed round first: the first updates after a fill can be far
+    // slower, paying for deferred reclamation and fresh pages
+    for (size_t i = 0; i < batch; i++) hash_set->Add(absent[i]);
+    for (size_t i = 0; i < batch; i++) hash_set->Remove(absent[i]);
+    for (size_t begin = 0; !timer.Done(min_time, deadline);
+         begin = (begin + batch) % (absent.size() - batch + 1)) {
+      auto* keys = &queries[op.starts_with("contains") ? 0 : begin];
+      size_t n = op.starts_with("contains") ? queries.size() : batch;
+      // a set that misses an answer fails the case, which also keeps every
+      // call from being optimised away
+      size_t right = 0;
+      auto count = [&](auto call) {
+        return [&, call] {
+          for (size_t i = 0; i < n; i++) {
+            if (call(keys[i])) right++;
+          }
+          return n;
+        };
+      };
+      auto add = count([&](int key) { return hash_set->Add(key); });
+      auto remove = count([&](int key) { return hash_set->Remove(key); });
+      if (op == "add") {
+        timer.Time(add);
+        remove();
+      } else if (op == "remove") {
+        add();
+        timer.Time(remove);
+      } else if (op == "contains_hit") {
+        timer.Time(count([&](int key) { return hash_set->Contains(key); }));
+      } else {
+        timer.Time(count([&](int key) { return !hash_set->Contains(key); }));
+      }
+      size_t expected = op == "add" || op == "remove" ? 2 * n : n;
+      correct = correct && right == expected;
+    }
+  }
+  if (!correct) error = op + " gave a wrong answer";
+  return correct;
+}
+
+/**
+ * Runs every selected operation and size on a HashSetType, appending a
+ * result to |results| for each. Returns false if any case fails.
+ */
+template <typename HashSetType>
+bool RunSet(const std::string& name, const Options& options,
+            std::vector<Result>& results, std::string& error) {
+  std::mt19937_64 rng(options.seed);
+  for (const auto& size : options.sizes) {
+    std::vector<int> present(size.elements);
+    std::vector<int> absent(size.elements);
+    std::iota(present.begin(), present.end(), 0);
+    std::iota(absent.begin(), absent.end(), static_cast<int>(size.elements));
+    std::shuffle(present.begin(), present.end(), rng);
+    std::shuffle(absent.begin(), absent.end(), rng);
+
+    for (const char* op : kOps) {
+      if (!Selected(options.ops, op)) continue;
+      results.push_back({name, size.name, size.elements, op, {}});
+      for (size_t rep = 0; rep < options.reps; rep++) {
+        Timer timer;
+        if (!RunRep<HashSetType>(op, present, absent, options.min_time, timer,
+                                 error)) {
+          error = name + " at " + std::to_string(size.elements) + ": " + error;
+          return false;
+        }
+        results.back().nanos_per_op.push_back(timer.NanosPerOp());
+      }
+    }
+  }
+  return true;
+}
+
+using Run = bool (*)(const std::string&, const Options&, std::vector<Result>&,
+                     std::string&);
+
+struct SetEntry {
+  const char* name;
+  Run run;
+};
+
+constexpr SetEntry kSets[] = {
+    {"sequential", RunSet<HashSetSequential<int>>},
+    {"sequential_flat", RunSet<HashSetSequential<int, FlatTable<int>>>},
+    {"sequential_incremental",
+     RunSet<HashSetSequential<int, IncrementalTable<int>>>},
+    {"coarse_grained", RunSet<HashSetCoarseGrained<int>>},
+    {"flat_combining", RunSet<HashSetFlatCombining<int>>},
+    {"reader_writer", RunSet<HashSetReaderWriter<int>>},
+    {"striped", RunSet<HashSetStriped<int>>},
+    {"refinable", RunSet<HashSetRefinable<int>>},
+    {"lock_free", RunSet<HashSetLockFree<int>>},
+    {"prefiltered_coarse",
+     RunSet<HashSetPrefiltered<HashSetCoarseGrained<int>>>},
+    {"sharded_coarse", RunSet<HashSetSharded<HashSetCoarseGrained<int>>>},
+};
+
+/**
+ * Splits a comma-separated list.
+ */
+std::vector<std::string> Split(const std::string& list) {
+  std::vector<std::string> items;
+  for (size_t begin = 0; begin <= list.size();) {
+    size_t end = std::min(list.find(',', begin), list.size());
+    items.push_back(list.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return items;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options,
+                  std::string& error) {
+  for (int i = 1; i < argc; i++) {
+    std::string option(argv[i]);
+    auto value = [&](const char* name) {
+      return option.substr(std::string(name).size());
+    };
+    try {
+      if (option.starts_with("--sets=")) {
+        options.sets = Split(value("--sets="));
+      } else if (option.starts_with("--ops=")) {
+        options.ops = Split(value("--ops="));
+      } else if (option.starts_with("--sizes=")) {
+        options.sizes.clear();
+        for (const auto& size : Split(value("--sizes="))) {
+          options.sizes.push_back({size, std::stoul(size)});
+        }
+      } else if (option.starts_with("--min-time=")) {
+        options.min_time = std::stod(value("--min-time="));
+      } else if (option.starts_with("--reps=")) {
+        options.reps = std::stoul(value("--reps="));
+      } else if (option.starts_with("--seed=")) {
+        options.seed = std::stoull(value("--seed="));
+      } else if (option == "--format=text") {
+        options.format = ReportFormat::kText;
+      } else if (option == "--format=csv") {
+        options.format = ReportFormat::kCsv;
+      } else if (option == "--format=json") {
+        options.format = ReportFormat::kJson;
+      } else {
+        error = "unknown option " + option;
+        return false;
+      }
+    } catch (const std::logic_error&) {
+      error = "malformed option " + option;
+      return false;
+    }
+  }
+  if (options.reps == 0 || options.min_time <= 0) {
+    error = "--reps and --min-time must be positive";
+    return false;
+  }
+  for (const auto& size : options.sizes) {
+    if (size.elements == 0 || size.elements > size_t{1} << 30) {
+      error = "sizes must lie in [1, 2^30]";
+      return false;
+    }
+  }
+  for (const auto& name : options.sets) {
+    auto known = [&](const SetEntry& entry) { return name == entry.name; };
+    if (std::none_of(std::begin(kSets), std::end(kSets), known)) {
+      error = "unknown set " + name;
+      return false;
+    }
+  }
+  for (const auto& name : options.ops) {
+    if (std::find(std::begin(kOps), std::end(kOps), name) == std::end(kOps)) {
+      error = "unknown operation " + name;
+      return false;
+    }
+  }
+  return true;
+}
+
+void WriteResults(const std::vector<Result>& results, ReportFormat format) {
+  switch (format) {
+    case ReportFormat::kText:
+      std::cout << std::left << std::setw(24) << "set" << std::setw(6)
+                << "size" << std::right << std::setw(10) << "elements"
+                << "  " << std::left << std::setw(15) << "op" << std::right
+                << std::setw(12) << "ns/op" << std::setw(12) << "min ns/op"
+                << std::endl;
+      std::cout << std::fixed << std::setprecision(2);
+      for (const auto& result : results) {
+        std::cout << std::left << std::setw(24) << result.set << std::setw(6)
+                  << result.size << std::right << std::setw(10)
+                  << result.elements << "  " << std::left << std::setw(15)
+                  << result.op << std::right << std::setw(12)
+                  << result.Median() << std::setw(12) << result.Min()
+                  << std::endl;
+      }
+      break;
+    case ReportFormat::kCsv:
+      std::cout << "set,size,elements,op,reps,median_ns_per_op,min_ns_per_op"
+                << std::endl;
+      for (const auto& result : results) {
+        std::cout << result.set << ',' << result.size << ','
+                  << result.elements << ',' << result.op << ','
+                  << result.nanos_per_op.size() << ',' << result.Median()
+                  << ',' << result.Min() << std::endl;
+      }
+      break;
+    case ReportFormat::kJson:
+      std::cout << "[";
+      for (size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        std::cout << (i == 0 ? "" : ", ") << "{\"set\": \"" << result.set
+                  << "\", \"size\": \"" << result.size
+                  << "\", \"elements\": " << result.elements
+                  << ", \"op\": \"" << result.op
+                  << "\", \"reps\": " << result.nanos_per_op.size()
+                  << ", \"median_ns_per_op\": " << result.Median()
+                  << ", \"min_ns_per_op\": " << result.Min() << "}";
+      }
+      std::cout << "]" << std::endl;
+      break;
+    default:
+      std::abort();
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  std::string error;
+  if (!ParseOptions(argc, argv, options, error)) {
+    std::cerr << argv[0] << ": " << error << std::endl;
+    std::cerr << "Usage: " << argv[0]
+              << " [--sets=name,...] [--ops=name,...] [--sizes=N,...]"
+                 " [--min-time=S] [--reps=N] [--seed=N]"
+                 " [--format=text|csv|json]"
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<Result> results;
+  for (const auto& set : kSets) {
+    if (!Selected(options.sets, set.name)) continue;
+    if (!set.run(set.name, options, results, error)) {
+      std::cerr << argv[0] << " failed: " << error << std::endl;
+      return 1;
+    }
+  }
+  WriteResults(results, options.format);
+  return 0;
+}
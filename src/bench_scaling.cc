@@ -0,0 +1,335 @@
+// Runs every hash set over a range of thread counts on the same workload and
+// reports the median throughput of each, and its speedup over the sequential
+// set on one thread:
+//
+//   bench_scaling max_threads [--reps=N] [--warmup=N] [--capacity=N]
+//                 [--sets=name,...] [workload options]
+//
+// Thread counts double from 1 up to max_threads, which is always included.
+// Each configuration runs --warmup times unmeasured and then --reps times,
+// each on a fresh set. The workload options are those of the demos (see
+// Workload); --pin=1 spreads the threads over distinct CPUs, and --format
+// selects a text table, CSV or JSON. Throughputs are medians over the reps.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "src/benchmark.h"
+#include "src/hash_set_coarse_grained.h"
+#include "src/hash_set_flat_combining.h"
+#include "src/hash_set_lock_free.h"
+#include "src/hash_set_prefiltered.h"
+#include "src/hash_set_reader_writer.h"
+#include "src/hash_set_refinable.h"
+#include "src/hash_set_sequential.h"
+#include "src/hash_set_sharded.h"
+#include "src/hash_set_striped.h"
+#include "src/report.h"
+#include "src/util/locks.h"
+
+namespace {
+
+using benchmark::KeyGenerator;
+using benchmark::ReportFormat;
+using benchmark::RunReport;
+using benchmark::Workload;
+
+using Measure = bool (*)(const Workload&, const KeyGenerator&, size_t, size_t,
+                         RunReport&, std::string&);
+
+// the striped set with |Mutex| for its stripe locks
+template <typename Mutex>
+using StripedWith = HashSetStriped<int, std::hash<int>, DefaultBucketPolicy,
+                                   std::allocator<int>, false, Mutex>;
+
+struct SetEntry {
+  const char* name;
+  Measure measure;
+};
+
+// the baseline, which only ever runs on one thread
+constexpr SetEntry kSequential = {
+    "sequential", benchmark::MeasureWorkload<HashSetSequential<int>>};
+
+constexpr SetEntry kConcurrentSets[] = {
+    {"coarse_grained", benchmark::MeasureWorkload<HashSetCoarseGrained<int>>},
+    {"flat_combining", benchmark::MeasureWorkload<HashSetFlatCombining<int>>},
+    {"reader_writer", benchmark::MeasureWorkload<HashSetReaderWriter<int>>},
+    {"striped", benchmark::MeasureWorkload<HashSetStriped<int>>},
+    {"refinable", benchmark::MeasureWorkload<HashSetRefinable<int>>},
+    // with a cache line per bucket, trading cache footprint for no false
+    // sharing between neighbouring buckets
+    {"striped_padded",
+     benchmark::MeasureWorkload<HashSetStriped<
+         int, std::hash<int>, DefaultBucketPolicy, std::allocator<int>, true>>},
+    {"refinable_padded",
+     benchmark::MeasureWorkload<HashSetRefinable<
+         int, std::hash<int>, DefaultBucketPolicy, std::allocator<int>, true>>},
+    {"lock_free", benchmark::MeasureWorkload<HashSetLockFree<int>>},
+    // the lock-based sets with the spinning locks in place of std::mutex
+    {"coarse_ttas",
+     benchmark::MeasureWorkload<
+         HashSetCoarseGrained<int, ChainedTable<int>, TtasLock>>},
+    {"coarse_adaptive",
+     benchmark::MeasureWorkload<
+         HashSetCoarseGrained<int, ChainedTable<int>, AdaptiveMutex>>},
+    {"coarse_ticket",
+     benchmark::MeasureWorkload<
+         HashSetCoarseGrained<int, ChainedTable<int>, TicketLock>>},
+    {"striped_ttas", benchmark::MeasureWorkload<StripedWith<TtasLock>>},
+    {"striped_adaptive",
+     benchmark::MeasureWorkload<StripedWith<AdaptiveMutex>>},
+    {"striped_ticket", benchmark::MeasureWorkload<StripedWith<TicketLock>>},
+    // one shard per NUMA node, so a single shard where there is one node
+    {"sharded_coarse",
+     benchmark::MeasureWorkload<HashSetSharded<HashSetCoarseGrained<int>>>},
+    {"sharded_striped",
+     benchmark::MeasureWorkload<HashSetSharded<HashSetStriped<int>>>},
+    // a Bloom filter answering misses ahead of the set
+    {"prefiltered_coarse",
+     benchmark::MeasureWorkload<HashSetPrefiltered<HashSetCoarseGrained<int>>>},
+    {"prefiltered_striped",
+     benchmark::MeasureWorkload<HashSetPrefiltered<HashSetStriped<int>>>},
+};
+
+struct Options {
+  size_t max_threads = 1;
+  size_t reps = 5;
+  size_t warmup = 1;
+  size_t capacity = 16;
+  std::vector<std::string> sets;  // every concurrent set if empty
+};
+
+// The throughputs, in operations per second, of the reps of one
+// configuration.
+struct Scaling {
+  std::string set;
+  size_t threads;
+  std::vector<double> throughputs;
+
+  [[nodiscard]] double Median() const {
+    std::vector<double> sorted = throughputs;
+    std::sort(sorted.begin(), sorted.end());
+    size_t mid = sorted.size() / 2;
+    return sorted.size() % 2 == 1 ? sorted[mid]
+                                  : (sorted[mid - 1] + sorted[mid]) / 2;
+  }
+
+  [[nodiscard]] double Min() const {
+    return *std::min_element(throughputs.begin(), throughputs.end());
+  }
+
+  [[nodiscard]] double Max() const {
+    return *std::max_element(throughputs.begin(), throughputs.end());
+  }
+};
+
+/**
+ * Takes the options of this driver out of |args|, leaving the workload
+ * options. Returns false on a malformed one.
+ */
+bool ParseOptions(std::vector<char*>& args, Options& options,
+                  std::string& error) {
+  std::vector<char*> rest;
+  for (char* arg : args) {
+    std::string option(arg);
+    auto value = [&](const char* name) {
+      return option.substr(std::string(name).size());
+    };
+    try {
+      if (option.starts_with("--reps=")) {
+        options.reps = std::stoul(value("--reps="));
+      } else if (option.starts_with("--warmup=")) {
+        options.warmup = std::stoul(value("--warmup="));
+      } else if (option.starts_with("--capacity=")) {
+        options.capacity = std::stoul(value("--capacity="));
+      } else if (option.starts_with("--sets=")) {
+        std::string sets = value("--sets=");
+        for (size_t begin = 0; begin <= sets.size();) {
+          size_t end = std::min(sets.find(',', begin), sets.size());
+          options.sets.push_back(sets.substr(begin, end - begin));
+          begin = end + 1;
+        }
+      } else {
+        rest.push_back(arg);
+      }
+    } catch (const std::logic_error&) {
+      error = "malformed option " + option;
+      return false;
+    }
+  }
+  if (options.reps == 0 || options.capacity == 0) {
+    error = "--reps and --capacity must be positive";
+    return false;
+  }
+  for (const auto& name : options.sets) {
+    auto known = [&](const SetEntry& entry) { return name == entry.name; };
+    if (std::none_of(std::begin(kConcurrentSets), std::end(kConcurrentSets),
+                     known)) {
+      error = "unknown set " + name;
+      return false;
+    }
+  }
+  args = rest;
+  return true;
+}
+
+/**
+ * Returns 1, 2, 4, ... up to and including |max_threads|.
+ */
+std::vector<size_t> ThreadCounts(size_t max_threads) {
+  std::vector<size_t> counts;
+  for (size_t threads = 1; threads < max_threads; threads *= 2) {
+    counts.push_back(threads);
+  }
+  counts.push_back(max_threads);
+  return counts;
+}
+
+/**
+ * Runs |set| on |threads| threads, warm-up runs first, and records the
+ * throughput of every measured run. Returns false if any run fails.
+ */
+bool Run(const SetEntry& set, size_t threads, const Options& options,
+         const Workload& workload, const KeyGenerator& keys, Scaling& scaling,
+         std::string& error) {
+  scaling = Scaling{set.name, threads, {}};
+  for (size_t rep = 0; rep < options.warmup + options.reps; rep++) {
+    RunReport report;
+    if (!set.measure(workload, keys, threads, options.capacity, report,
+                     error)) {
+      error = std::string(set.name) + " failed: " + error;
+      return false;
+    }
+    if (rep < options.warmup) continue;
+
+    size_t ops = 0;
+    for (const auto& result : report.results) {
+      ops += result.Ops();
+    }
+    scaling.throughputs.push_back(static_cast<double>(ops) / report.seconds);
+  }
+  return true;
+}
+
+void WriteScaling(const std::vector<Scaling>& rows, double baseline,
+                  const Workload& workload) {
+  auto speedup = [baseline](const Scaling& row) {
+    return row.Median() / baseline;
+  };
+  std::string described = benchmark::DescribeWorkload(workload);
+
+  switch (workload.format) {
+    case ReportFormat::kText:
+      std::cout << "Workload: " << described << std::endl;
+      std::cout << std::left << std::setw(20) << "set" << std::right
+                << std::setw(8) << "threads" << std::setw(14) << "ops/s"
+                << std::setw(10) << "speedup" << std::setw(12) << "efficiency"
+                << std::endl;
+      std::cout << std::fixed << std::setprecision(2);
+      for (const auto& row : rows) {
+        std::cout << std::left << std::setw(20) << row.set << std::right
+                  << std::setw(8) << row.threads << std::setw(14)
+                  << static_cast<uint64_t>(row.Median()) << std::setw(10)
+                  << speedup(row) << std::setw(12)
+                  << speedup(row) / static_cast<double>(row.threads)
+                  << std::endl;
+      }
+      break;
+    case ReportFormat::kCsv:
+      std::cout << "set,threads,reps,median_ops_per_sec,min_ops_per_sec,"
+                   "max_ops_per_sec,speedup,workload"
+                << std::endl;
+      for (const auto& row : rows) {
+        std::cout << row.set << ',' << row.threads << ','
+                  << row.throughputs.size() << ','
+                  << static_cast<uint64_t>(row.Median()) << ','
+                  << static_cast<uint64_t>(row.Min()) << ','
+                  << static_cast<uint64_t>(row.Max()) << ',' << speedup(row)
+                  << ',';
+        benchmark::WriteQuoted(std::cout, described, /*json=*/false);
+        std::cout << std::endl;
+      }
+      break;
+    case ReportFormat::kJson:
+      std::cout << "{\"workload\": ";
+      benchmark::WriteQuoted(std::cout, described, /*json=*/true);
+      std::cout << ", \"rows\": [";
+      for (size_t i = 0; i < rows.size(); i++) {
+        const auto& row = rows[i];
+        std::cout << (i == 0 ? "" : ", ") << "{\"set\": \"" << row.set
+                  << "\", \"threads\": " << row.threads
+                  << ", \"reps\": " << row.throughputs.size()
+                  << ", \"median_ops_per_sec\": "
+                  << static_cast<uint64_t>(row.Median())
+                  << ", \"min_ops_per_sec\": "
+                  << static_cast<uint64_t>(row.Min())
+                  << ", \"max_ops_per_sec\": "
+                  << static_cast<uint64_t>(row.Max())
+                  << ", \"speedup\": " << speedup(row) << "}";
+      }
+      std::cout << "]}" << std::endl;
+      break;
+    default:
+      std::abort();
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2 || benchmark::IsWorkloadOption(argv[1])) {
+    std::cerr << "Usage: " << argv[0]
+              << " max_threads [--reps=N] [--warmup=N] [--capacity=N]"
+                 " [--sets=name,...] [--name=value...]"
+              << std::endl;
+    return 1;
+  }
+  Options options;
+  options.max_threads = std::max<size_t>(1, std::stoul(std::string(argv[1])));
+
+  std::vector<char*> args(argv + 2, argv + argc);
+  Workload workload;
+  std::string error;
+  if (!ParseOptions(args, options, error) ||
+      !benchmark::ParseWorkload(args, workload, error)) {
+    std::cerr << argv[0] << ": " << error << std::endl;
+    return 1;
+  }
+  KeyGenerator keys(workload);
+
+  std::vector<Scaling> rows;
+  auto run = [&](const SetEntry& set, size_t threads) {
+    rows.emplace_back();
+    if (Run(set, threads, options, workload, keys, rows.back(), error)) {
+      return true;
+    }
+    std::cerr << argv[0] << ": " << error << std::endl;
+    return false;
+  };
+
+  if (!run(kSequential, 1)) return 1;
+  double baseline = rows.front().Median();
+  for (const auto& set : kConcurrentSets) {
+    if (!options.sets.empty() &&
+        std::find(options.sets.begin(), options.sets.end(), set.name) ==
+            options.sets.end()) {
+      continue;
+    }
+    for (size_t threads : ThreadCounts(options.max_threads)) {
+      if (!run(set, threads)) return 1;
+    }
+  }
+
+  WriteScaling(rows, baseline, workload);
+  return 0;
+}
@@ -2,24 +2,113 @@
 #define BENCHMARK_H
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstddef>
 #include <iostream>
+#include <latch>
+#include <span>
+#include <string>
 #include <thread>
 #include <vector>
 
 #include "src/hash_set_base.h"
+#include "src/report.h"
+#include "src/util/affinity.h"
+#include "src/workload.h"
 
 namespace benchmark {
 
-void ThreadBody(HashSetBase<int>& hash_set, size_t chunk_size, size_t id,
-                size_t& max_observed_size);
+// The fixed pattern each of the first mode's threads runs: adds a chunk that
+// overlaps the next thread's, removes every twentieth element, and adds the
+// chunk again. A template, so that the set's calls bind statically.
+template <HashSet<int> HashSetType>
+void ThreadBody(HashSetType& hash_set, size_t chunk_size, size_t id,
+                size_t& max_observed_size) {
+  max_observed_size = 0;
+  for (size_t k = 0; k < chunk_size * 2; k++) {
+    int elem = static_cast<int>(id * chunk_size + k);
+    hash_set.Add(elem);
+    max_observed_size = std::max(max_observed_size, hash_set.ApproxSize());
+  }
+  for (size_t j = 0; j < 20; j++) {
+    for (size_t k = 0; k < chunk_size * 2; k++) {
+      int elem = static_cast<int>(id * chunk_size + k);
+      if (hash_set.Contains(elem)) {
+        if ((elem % 20) == 0) {
+          hash_set.Remove(elem);
+          max_observed_size =
+              std::max(max_observed_size, hash_set.ApproxSize());
+        }
+      }
+    }
+  }
+  for (size_t k = 0; k < chunk_size * 2; k++) {
+    int elem = static_cast<int>(id * chunk_size + k);
+    hash_set.Add(elem);
+    max_observed_size = std::max(max_observed_size, hash_set.ApproxSize());
+  }
+}
+
+// Holds threads back until every one of them has started, so that the time
+// taken to spawn them is not measured.
+class StartBarrier {
+ public:
+  explicit StartBarrier(size_t threads)
+      : ready_(static_cast<std::ptrdiff_t>(threads)) {}
+
+  // Called by each thread before its first operation.
+  void Wait() {
+    ready_.count_down();
+    go_.wait(false);
+  }
+
+  // Waits for every thread to be ready, then releases them all, returning the
+  // time at which it did.
+  std::chrono::steady_clock::time_point Release() {
+    ready_.wait();
+    auto now = std::chrono::steady_clock::now();
+    go_.store(true);
+    go_.notify_all();
+    return now;
+  }
+
+ private:
+  std::latch ready_;
+  std::atomic<bool> go_{false};
+};
 
-template <typename HashSetType>
+// Runs the workload described by |options| (see Workload) on |num_threads|
+// threads sharing a HashSetType, and checks the final size against the
+// updates that succeeded. |name| prefixes the output.
+template <HashSet<int> HashSetType>
+int RunWorkload(const char* name, size_t num_threads, size_t initial_capacity,
+                std::span<char* const> options);
+
+// Runs |workload| on |num_threads| threads sharing a fresh HashSetType, filling
+// in |report| apart from its set name. Returns false, describing the failure
+// in |error|, if the final size does not match the updates that succeeded.
+template <HashSet<int> HashSetType>
+bool MeasureWorkload(const Workload& workload, const KeyGenerator& keys,
+                     size_t num_threads, size_t initial_capacity,
+                     RunReport& report, std::string& error);
+
+// Runs either the fixed pattern of ThreadBody, given a chunk size, or the
+// workload described by the options (see Workload), on a HashSetType.
+template <HashSet<int> HashSetType>
 int RunBenchmark(int argc, char** argv) {
+  if (argc >= 3 && (argc == 3 || IsWorkloadOption(argv[3]))) {
+    return RunWorkload<HashSetType>(
+        argv[0], std::stoul(std::string(argv[1])),
+        std::stoul(std::string(argv[2])),
+        std::span<char* const>(argv + 3, argv + argc));
+  }
   if (argc != 4) {
     std::cerr << "Usage: " << argv[0]
               << " num_threads initial_capacity chunk_size" << std::endl;
+    std::cerr << "       " << argv[0]
+              << " num_threads initial_capacity [--name=value...]"
+              << std::endl;
     return 1;
   }
   size_t num_threads = std::stoul(std::string(argv[1]));
@@ -37,15 +126,18 @@ int RunBenchmark(int argc, char** argv) {
   std::vector<std::thread> threads;
   threads.reserve(num_threads);
 
-  auto begin_time = std::chrono::high_resolution_clock::now();
+  StartBarrier start(num_threads);
   for (size_t i = 0; i < num_threads; i++) {
-    threads.emplace_back(std::thread(ThreadBody, std::ref(hash_set), chunk_size,
-                                     i, std::ref(max_observed_sizes.at(i))));
+    threads.emplace_back([&, i] {
+      start.Wait();
+      ThreadBody(hash_set, chunk_size, i, max_observed_sizes.at(i));
+    });
   }
+  auto begin_time = start.Release();
   for (auto& thread : threads) {
     thread.join();
   }
-  auto end_time = std::chrono::high_resolution_clock::now();
+  auto end_time = std::chrono::steady_clock::now();
 
   auto duration = end_time - begin_time;
   auto millis =
@@ -57,9 +149,11 @@ int RunBenchmark(int argc, char** argv) {
               << " does not match expected size " << expected_size << std::endl;
     return 1;
   }
-  for (size_t i = 0; i < chunk_size * (num_threads + 1); i++) {
+  // the snapshot is sorted, so it must hold exactly 0, 1, ..., in order
+  auto elems = hash_set.Snapshot();
+  for (size_t i = 0; i < expected_size; i++) {
     int expected_value = static_cast<int>(i);
-    if (!hash_set.Contains(expected_value)) {
+    if (i >= elems.size() || elems[i] != expected_value) {
       std::cerr << argv[0] << " failed: expected value " << expected_value
                 << " not found" << std::endl;
       return 1;
@@ -72,6 +166,84 @@ int RunBenchmark(int argc, char** argv) {
   return 0;
 }
 
+template <HashSet<int> HashSetType>
+bool MeasureWorkload(const Workload& workload, const KeyGenerator& keys,
+                     size_t num_threads, size_t initial_capacity,
+                     RunReport& report, std::string& error) {
+  HashSetType hash_set(initial_capacity);
+  Prefill(hash_set, workload);
+
+  report.threads = num_threads;
+  report.workload = DescribeWorkload(workload);
+  report.results.assign(num_threads, WorkloadResult{});
+  StartBarrier start(num_threads);
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back([&, i] {
+      if (workload.pin_threads) PinThisThread(i);
+      start.Wait();
+      WorkloadThreadBody(hash_set, workload, keys, i, report.results[i]);
+    });
+  }
+  auto begin_time = start.Release();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto end_time = std::chrono::steady_clock::now();
+  report.seconds = std::chrono::duration<double>(end_time - begin_time).count();
+  report.stats = hash_set.Stats();
+
+  WorkloadResult total;
+  for (const auto& result : report.results) {
+    total += result;
+  }
+
+  // every successful update changed the size by one, whatever the interleaving
+  size_t expected_size = workload.prefill + total.inserted - total.removed;
+  if (hash_set.Size() != expected_size) {
+    error = "size " + std::to_string(hash_set.Size()) +
+            " does not match expected size " + std::to_string(expected_size);
+    return false;
+  }
+  return true;
+}
+
+template <HashSet<int> HashSetType>
+int RunWorkload(const char* name, size_t num_threads, size_t initial_capacity,
+                std::span<char* const> options) {
+  Workload workload;
+  std::string error;
+  if (!ParseWorkload(options, workload, error)) {
+    std::cerr << name << ": " << error << std::endl;
+    return 1;
+  }
+
+  KeyGenerator keys(workload);
+  RunReport report;
+  report.set = std::string(name).substr(std::string(name).rfind('/') + 1);
+  if (!MeasureWorkload<HashSetType>(workload, keys, num_threads,
+                                    initial_capacity, report, error)) {
+    std::cerr << name << " failed: " << error << std::endl;
+    return 1;
+  }
+
+  if (workload.format == ReportFormat::kText) {
+    WorkloadResult total;
+    for (const auto& result : report.results) {
+      total += result;
+    }
+    std::cout << name << " succeeded" << std::endl;
+    std::cout << "  " << total.reads << " reads (" << total.hits
+              << " hits), " << total.inserts << " inserts (" << total.inserted
+              << " new), " << total.removes << " removes (" << total.removed
+              << " present)" << std::endl;
+  }
+  WriteReport(std::cout, report, workload.format);
+  return 0;
+}
+
 }  // namespace benchmark
 
 #endif  // BENCHMARK_H
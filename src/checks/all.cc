@@ -1,7 +1,25 @@
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include "src/hash_set_coarse_grained.h"
+#include "src/hash_set_file.h"
+#include "src/hash_set_flat_combining.h"
+#include "src/hash_set_lock_free.h"
+#include "src/hash_set_prefiltered.h"
+#include "src/hash_set_reader_writer.h"
 #include "src/hash_set_refinable.h"
 #include "src/hash_set_sequential.h"
+#include "src/hash_set_sharded.h"
 #include "src/hash_set_striped.h"
+#include "src/table/flat_table.h"
+#include "src/table/incremental_table.h"
+#include "src/table/mapped_flat_table.h"
+#include "src/util/arena.h"
+#include "src/util/hash_policy.h"
+#include "src/util/locks.h"
 
 namespace check_all {
 
@@ -16,6 +34,150 @@ void Placeholder() {
     (void)hs.Contains(1);
   }
 
+  {
+    HashSetCoarseGrained<int, FlatTable<int>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetCoarseGrained<int, IncrementalTable<int>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetCoarseGrained<
+        int, IncrementalTable<int, 8, MixHash<int>, Pow2BucketPolicy>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetCoarseGrained<
+        int, IncrementalTable<int, 8, std::hash<int>, DefaultBucketPolicy,
+                              ArenaAllocator<int, BumpArena>>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetFlatCombining<int> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetFlatCombining<int, FlatTable<int>> hs(16);
+    std::vector<int> elems = {1, 2};
+    (void)hs.AddAll(elems);
+    (void)hs.ContainsAll(elems);
+    (void)hs.RemoveAll(elems);
+  }
+
+  {
+    HashSetFlatCombining<int, IncrementalTable<int>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  // the spinning locks in place of std::mutex
+  {
+    HashSetCoarseGrained<int, ChainedTable<int>, TtasLock> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetCoarseGrained<int, FlatTable<int>, AdaptiveMutex> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetFlatCombining<int, ChainedTable<int>, TicketLock> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetStriped<int, std::hash<int>, DefaultBucketPolicy,
+                   std::allocator<int>, false, TicketLock> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetRefinable<int, std::hash<int>, DefaultBucketPolicy,
+                     std::allocator<int>, true, AdaptiveMutex> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetPrefiltered<HashSetCoarseGrained<int>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetPrefiltered<HashSetLockFree<int>> hs(16);
+    std::vector<int> elems = {1, 2};
+    (void)hs.AddAll(elems);
+    (void)hs.ContainsAll(elems);
+    (void)hs.RemoveAll(elems);
+    hs.Reserve(64);
+    hs.ShrinkToFit();
+  }
+
+  {
+    HashSetLockFree<int> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetLockFree<int, MixHash<int>, BucketPolicy<8, 2, true>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetReaderWriter<int> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
   {
     HashSetRefinable<int> hs(16);
     hs.Add(1);
@@ -24,6 +186,23 @@ void Placeholder() {
     (void)hs.Contains(1);
   }
 
+  {
+    HashSetRefinable<int, MixHash<int>, BucketPolicy<2, 4, false, 8>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetRefinable<int, std::hash<int>, DefaultBucketPolicy,
+                     ArenaAllocator<int, ShardedArena>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
   {
     HashSetSequential<int> hs(16);
     hs.Add(1);
@@ -32,6 +211,42 @@ void Placeholder() {
     (void)hs.Contains(1);
   }
 
+  {
+    HashSetSequential<int, ChainedTable<int, MixHash<int>, Pow2BucketPolicy>>
+        hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetSequential<
+        int, ChainedTable<int, std::hash<int>, DefaultBucketPolicy,
+                          ArenaAllocator<int, BumpArena>>>
+        hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetSequential<int, FlatTable<int>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetSequential<int, IncrementalTable<int>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
   {
     HashSetStriped<int> hs(16);
     hs.Add(1);
@@ -39,6 +254,219 @@ void Placeholder() {
     (void)hs.Size();
     (void)hs.Contains(1);
   }
+
+  {
+    HashSetStriped<int, MixHash<int>, Pow2BucketPolicy> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetStriped<int, std::hash<int>, DefaultBucketPolicy,
+                   ArenaAllocator<int, ShardedArena>> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetStriped<int, std::hash<int>, DefaultBucketPolicy,
+                   ArenaAllocator<int, ShardedArena>, true> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetRefinable<int, std::hash<int>, DefaultBucketPolicy,
+                     std::allocator<int>, true> hs(16);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  {
+    HashSetSharded<HashSetCoarseGrained<int>> hs(16, NumaTopology::Uniform(2),
+                                                 4);
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+    (void)hs.NodeOf(hs.ShardOf(1));
+  }
+
+  {
+    HashSetSharded<HashSetLockFree<int>> hs(
+        16, NumaTopology::Detect(), 2,
+        [](size_t node) {
+          (void)NumaTopology::Detect().PinThisThreadToNode(node);
+        });
+    hs.Add(1);
+    hs.Remove(1);
+    (void)hs.Size();
+    (void)hs.Contains(1);
+  }
+
+  // saving and loading
+  {
+    HashSetStriped<int> hs(16);
+    std::string error;
+    (void)SaveHashSet(hs, "set.bin", error);
+    (void)LoadHashSet(hs, "set.bin", 4, error);
+  }
+
+  {
+    HashSetCoarseGrained<int, FlatTable<int>> hs(16);
+    std::string error;
+    (void)hs.SaveTable("table.bin", error);
+    MappedFlatTable<int> table;
+    if (table.Open("table.bin", error)) (void)table.Contains(1);
+  }
+
+  {
+    HashSetSequential<int, FlatTable<int, FlatGroupPortable, MixHash<int>>>
+        hs(16);
+    std::string error;
+    (void)hs.SaveTable("table.bin", error);
+    MappedFlatTable<int, FlatGroupPortable, MixHash<int>> table;
+    if (table.Open("table.bin", error)) (void)table.Size();
+  }
+
+  // move-aware adds, lookups by std::string_view and literal, and snapshots
+  {
+    HashSetCoarseGrained<std::string, ChainedTable<std::string, StringHash>>
+        hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetFlatCombining<std::string, ChainedTable<std::string, StringHash>>
+        hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetPrefiltered<
+        HashSetStriped<std::string, StringHash>, StringHash> hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetLockFree<std::string, StringHash> hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetRefinable<std::string, StringHash> hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetSequential<std::string, ChainedTable<std::string, StringHash>>
+        hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetSequential<std::string,
+                      FlatTable<std::string, FlatGroup, StringHash>>
+        hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetSequential<std::string, IncrementalTable<std::string, 8, StringHash>>
+        hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetStriped<std::string, StringHash> hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
+
+  {
+    HashSetSharded<
+        HashSetSequential<std::string, ChainedTable<std::string, StringHash>>,
+        StringHash>
+        hs(16);
+    std::string elem = "a";
+    hs.Add(elem);
+    hs.Add(std::string("b"));
+    hs.Emplace(size_t{3}, 'c');
+    hs.Remove("a");
+    (void)hs.Size();
+    (void)hs.Contains(std::string_view("b"));
+    (void)hs.Snapshot();
+  }
 }
 
 }  // namespace check_all
@@ -2,6 +2,8 @@
 
 namespace check_coarse_grained {
 
+static_assert(HashSet<HashSetCoarseGrained<int>, int>);
+
 void Placeholder();
 
 void Placeholder() {
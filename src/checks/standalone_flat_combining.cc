@@ -0,0 +1,17 @@
+#include "src/hash_set_flat_combining.h"
+
+namespace check_flat_combining {
+
+static_assert(HashSet<HashSetFlatCombining<int>, int>);
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetFlatCombining<int> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+}
+
+}  // namespace check_flat_combining
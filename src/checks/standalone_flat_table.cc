@@ -0,0 +1,20 @@
+#include "src/table/flat_table.h"
+
+namespace check_flat_table {
+
+void Placeholder();
+
+void Placeholder() {
+  FlatTable<int> table(16);
+  table.Add(1);
+  table.Remove(1);
+  (void)table.Size();
+  (void)table.Contains(1);
+  if (table.NeedsResize()) table.Resize();
+
+  FlatTable<int, FlatGroupPortable> portable(16);
+  portable.Add(1);
+  (void)portable.Contains(1);
+}
+
+}  // namespace check_flat_table
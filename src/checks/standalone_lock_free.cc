@@ -0,0 +1,17 @@
+#include "src/hash_set_lock_free.h"
+
+namespace check_lock_free {
+
+static_assert(HashSet<HashSetLockFree<int>, int>);
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetLockFree<int> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+}
+
+}  // namespace check_lock_free
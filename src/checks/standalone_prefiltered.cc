@@ -0,0 +1,18 @@
+#include "src/hash_set_prefiltered.h"
+#include "src/hash_set_striped.h"
+
+namespace check_prefiltered {
+
+static_assert(HashSet<HashSetPrefiltered<HashSetStriped<int>>, int>);
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetPrefiltered<HashSetStriped<int>> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+}
+
+}  // namespace check_prefiltered
@@ -0,0 +1,17 @@
+#include "src/hash_set_reader_writer.h"
+
+namespace check_reader_writer {
+
+static_assert(HashSet<HashSetReaderWriter<int>, int>);
+
+void Placeholder();
+
+void Placeholder() {
+  HashSetReaderWriter<int> hs(16);
+  hs.Add(1);
+  hs.Remove(1);
+  (void)hs.Size();
+  (void)hs.Contains(1);
+}
+
+}  // namespace check_reader_writer
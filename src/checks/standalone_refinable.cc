@@ -2,6 +2,8 @@
 
 namespace check_refinable {
 
+static_assert(HashSet<HashSetRefinable<int>, int>);
+
 void Placeholder();
 
 void Placeholder() {
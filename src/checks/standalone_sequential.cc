@@ -2,6 +2,8 @@
 
 namespace check_sequential {
 
+static_assert(HashSet<HashSetSequential<int>, int>);
+
 void Placeholder();
 
 void Placeholder() {
@@ -2,6 +2,8 @@
 
 namespace check_striped {
 
+static_assert(HashSet<HashSetStriped<int>, int>);
+
 void Placeholder();
 
 void Placeholder() {
@@ -0,0 +1,6 @@
+#include "src/benchmark.h"
+#include "src/hash_set_flat_combining.h"
+
+int main(int argc, char** argv) {
+  return benchmark::RunBenchmark<HashSetFlatCombining<int>>(argc, argv);
+}
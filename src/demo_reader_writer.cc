@@ -0,0 +1,6 @@
+#include "src/benchmark.h"
+#include "src/hash_set_reader_writer.h"
+
+int main(int argc, char** argv) {
+  return benchmark::RunBenchmark<HashSetReaderWriter<int>>(argc, argv);
+}
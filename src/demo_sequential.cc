@@ -1,10 +1,20 @@
 #include <iostream>
+#include <span>
 
+#include "src/benchmark.h"
 #include "src/hash_set_sequential.h"
 
 int main(int argc, char** argv) {
+  // the sequential set is not thread-safe, so workloads run on one thread
+  if (argc >= 2 && (argc == 2 || benchmark::IsWorkloadOption(argv[2]))) {
+    return benchmark::RunWorkload<HashSetSequential<int>>(
+        argv[0], 1, std::stoul(std::string(argv[1])),
+        std::span<char* const>(argv + 2, argv + argc));
+  }
   if (argc != 3) {
     std::cerr << "Usage: " << argv[0] << " initial_capacity count" << std::endl;
+    std::cerr << "       " << argv[0] << " initial_capacity [--name=value...]"
+              << std::endl;
     return 1;
   }
   size_t initial_capacity = std::stoul(std::string(argv[1]));
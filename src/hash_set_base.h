@@ -1,26 +1,157 @@
 #ifndef HASH_SET_BASE_H
 #define HASH_SET_BASE_H
 
+#include <algorithm>
+#include <concepts>
 #include <cstddef>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "src/util/set_stats.h"
 
 template <typename T>
 class HashSetBase {
  public:
+  using value_type = T;
+
   virtual ~HashSetBase() = default;
 
-  // Adds |elem| to the hash set. Returns true if |elem| was absent, and false
-  // otherwise.
-  virtual bool Add(T elem) = 0;
+  // Adds |elem| to the hash set, moving it in if it was absent. Returns true if
+  // |elem| was absent, and false otherwise.
+  virtual bool Add(T&& elem) = 0;
+
+  // As above, copying |elem| in only if it was absent.
+  virtual bool Add(const T& elem) = 0;
+
+  // Adds the T constructed from |args|, returning as Add() does.
+  template <typename... Args>
+  bool Emplace(Args&&... args) {
+    return Add(T(std::forward<Args>(args)...));
+  }
 
   // Removes |elem| from the hash set. Returns true if |elem| was present, and
   // false otherwise.
-  virtual bool Remove(T elem) = 0;
+  virtual bool Remove(const T& elem) = 0;
 
   // Returns true if |elem| is present in the hash set, and false otherwise.
-  [[nodiscard]] virtual bool Contains(T elem) = 0;
+  //
+  // Sets whose hasher is transparent (declares is_transparent, as StringHash
+  // does) also overload Remove() and Contains() for any TransparentKey, such
+  // as a std::string_view into a set of std::string, so that looking one up
+  // constructs no T.
+  [[nodiscard]] virtual bool Contains(const T& elem) = 0;
+
+  // Calls |fn(elem)| for the elements of the hash set, in no particular order.
+  // Under concurrent updates the walk is weakly consistent: every element
+  // present throughout it is visited exactly once, and elements added or
+  // removed meanwhile may or may not be. No set holds a lock over every bucket
+  // for the whole walk; each documents what it holds while |fn| runs.
+  virtual void ForEach(const std::function<void(const T&)>& fn) = 0;
+
+  // Returns the elements in ascending order, for checkpointing. They are those
+  // present at one point during the call, except in sets that cannot pause
+  // their updates (the lock-free set), which return what ForEach() visits.
+  // Writers wait at most while the elements are copied, never for the sort.
+  [[nodiscard]] std::vector<T> Snapshot()
+    requires std::totally_ordered<T>
+  {
+    std::vector<T> elems = SnapshotElements_();
+    std::sort(elems.begin(), elems.end());
+    return elems;
+  }
 
   // Returns the size of the hash set.
   [[nodiscard]] virtual size_t Size() const = 0;
+
+  // Returns the size of the hash set, possibly lagging behind concurrent
+  // updates, without the synchronisation an exact Size() may need. Suited to
+  // monitoring and resize heuristics. Exact when the set is not being updated.
+  [[nodiscard]] virtual size_t ApproxSize() const { return Size(); }
+
+  // Sizes the hash set up front to hold |n| elements without resizing, so that
+  // bulk loads skip every intermediate growth. Never shrinks. The default does
+  // nothing.
+  virtual void Reserve(size_t n) { (void)n; }
+
+  // Releases memory held beyond what the current elements need, shrinking the
+  // table as far as the constructed capacity. The default does nothing.
+  virtual void ShrinkToFit() {}
+
+  // Returns what the set's instrumentation has counted so far (see SetStats).
+  // Empty unless built with HASH_SET_STATS, and by default.
+  [[nodiscard]] virtual SetStats Stats() const { return {}; }
+
+  // Batch variants of Add, Remove and Contains. Bit i of the result is what the
+  // single-element call would have returned for |elems[i]|. Occurrences of the
+  // same element within a batch are applied in order, but the batch as a whole
+  // is not atomic. The defaults simply loop; implementations override them to
+  // hash the batch once, take each lock once per group of elements and
+  // prefetch buckets ahead of use.
+  virtual std::vector<bool> AddAll(std::span<const T> elems) {
+    std::vector<bool> result(elems.size());
+    for (size_t i = 0; i < elems.size(); i++) {
+      result[i] = Add(elems[i]);
+    }
+    return result;
+  }
+
+  virtual std::vector<bool> RemoveAll(std::span<const T> elems) {
+    std::vector<bool> result(elems.size());
+    for (size_t i = 0; i < elems.size(); i++) {
+      result[i] = Remove(elems[i]);
+    }
+    return result;
+  }
+
+  [[nodiscard]] virtual std::vector<bool> ContainsAll(
+      std::span<const T> elems) {
+    std::vector<bool> result(elems.size());
+    for (size_t i = 0; i < elems.size(); i++) {
+      result[i] = Contains(elems[i]);
+    }
+    return result;
+  }
+
+ protected:
+  /**
+   * Returns the elements of Snapshot() in any order. By default, those that
+   * ForEach() visits.
+   */
+  virtual std::vector<T> SnapshotElements_() {
+    std::vector<T> elems;
+    elems.reserve(ApproxSize());
+    ForEach([&](const T& elem) { elems.push_back(elem); });
+    return elems;
+  }
+};
+
+// The interface of HashSetBase<T> as a concept, for code that takes the set's
+// type as a template parameter instead of a HashSetBase<T>&. Every set marks
+// its overrides final, so calls through its own type bind statically and can
+// be inlined into the caller's loop. HashSetBase<T> satisfies the concept too,
+// for callers that want runtime polymorphism.
+template <typename Set, typename T>
+concept HashSet = requires(Set& set, const Set& const_set, const T& elem,
+                           size_t n, std::span<const T> elems,
+                           const std::function<void(const T&)>& fn) {
+  { set.Add(T(elem)) } -> std::same_as<bool>;
+  { set.Add(elem) } -> std::same_as<bool>;
+  { set.Emplace(elem) } -> std::same_as<bool>;
+  set.ForEach(fn);
+  { set.Remove(elem) } -> std::same_as<bool>;
+  { set.Contains(elem) } -> std::same_as<bool>;
+  { const_set.Size() } -> std::same_as<size_t>;
+  { const_set.ApproxSize() } -> std::same_as<size_t>;
+  set.Reserve(n);
+  set.ShrinkToFit();
+  { const_set.Stats() } -> std::same_as<SetStats>;
+  { set.AddAll(elems) } -> std::same_as<std::vector<bool>>;
+  { set.RemoveAll(elems) } -> std::same_as<std::vector<bool>>;
+  { set.ContainsAll(elems) } -> std::same_as<std::vector<bool>>;
 };
 
+static_assert(HashSet<HashSetBase<int>, int>);
+
 #endif  // HASH_SET_BASE_H
@@ -1,113 +1,325 @@
 #ifndef HASH_SET_COARSE_GRAINED_H
 #define HASH_SET_COARSE_GRAINED_H
 
-#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <functional>
 #include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "src/hash_set_base.h"
+#include "src/table/chained_table.h"
+#include "src/util/batch.h"
+#include "src/util/cache_line.h"
+#include "src/util/cooperative_rehash.h"
+#include "src/util/hash_policy.h"
+#include "src/util/resize_gate.h"
+#include "src/util/set_stats.h"
 
-template <typename T>
+// |Table| selects the storage backend from src/table/: ChainedTable (the
+// default), FlatTable, or IncrementalTable to spread each resize over later
+// operations.
+//
+// |Mutex| is the single lock guarding the table: std::mutex, or one of the
+// spinning locks in src/util/locks.h. If it is shared-lockable, as
+// std::shared_mutex is, Contains, ContainsAll and Size take it in shared mode
+// so that readers proceed in parallel; mutations and rehashing always take it
+// exclusively.
+//
+// If |Table| can resize in steps, as ChainedTable with a thread-safe allocator
+// can, threads that need the lock while a large table is being grown help
+// migrate its buckets instead of blocking on it.
+template <typename T, typename Table = ChainedTable<T>,
+          typename Mutex = std::mutex>
 class HashSetCoarseGrained : public HashSetBase<T> {
  public:
-  explicit HashSetCoarseGrained(const size_t capacity)
-      : table_(capacity), set_size_(0) {
+  explicit HashSetCoarseGrained(const size_t capacity) : table_(capacity) {
     assert(capacity > 0);
   }
 
-  bool Add(T elem) final {
-    {
-      // scope-lock for mutual exclusion
-      std::scoped_lock<std::mutex> lock(mutex_);
+  bool Add(T&& elem) final { return Add_(std::move(elem)); }
 
-      auto& bucket = Bucket_(elem);
+  bool Add(const T& elem) final { return Add_(elem); }
 
-      // 3) return false on duplicate (loops over the elements in that bucket)
-      if (std::find(bucket.begin(), bucket.end(), elem) != bucket.end()) {
-        return false;
-      }
+  bool Remove(const T& elem) final { return Remove_(elem); }
 
-      // 4) insert and update size if not present
-      bucket.push_back(std::move(elem));
-      set_size_++;
-    }  // release lock
+  [[nodiscard]] bool Contains(const T& elem) final { return Contains_(elem); }
 
-    // 5) apply resizing policy if needed
-    ResizeIfNeeded_();
-    return true;
+  // Lookups by a key that |Table|'s hasher accepts in place of a T.
+  template <TransparentKey<T, typename Table::hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove_(key);
   }
 
-  bool Remove(T elem) final {
-    // scope-lock for mutual exclusion
-    std::scoped_lock<std::mutex> lock(mutex_);
+  template <TransparentKey<T, typename Table::hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) {
+    return Contains_(key);
+  }
 
-    auto& bucket = Bucket_(elem);
+  // Copies the elements out under the lock, shared with other readers if
+  // possible, and then calls |fn| without it; the one lock guards every
+  // bucket, so there is no finer unit to walk by. The walk sees one point in
+  // time, and |fn| may update the set.
+  void ForEach(const std::function<void(const T&)>& fn) final {
+    for (const T& elem : SnapshotElements_()) fn(elem);
+  }
 
-    // find element position (returning early if doesn't exist)
-    auto i = std::find(bucket.begin(), bucket.end(), elem);
-    if (i == bucket.end()) return false;
+  [[nodiscard]] size_t Size() const final {
+    // scope-lock, shared with other readers if possible
+    auto lock = ReadLock_();
 
-    // remove element & decrement size
-    bucket.erase(i);
-    set_size_--;
-    return true;
+    return table_.Size();
   }
 
-  [[nodiscard]] bool Contains(T elem) final {
+  // Saves the table itself under the lock, shared with other readers if
+  // possible, for a |Table| whose image can be searched in place, as a
+  // FlatTable's can by MappedFlatTable.
+  bool SaveTable(const std::string& path, std::string& error) const
+    requires requires(const Table& table) { table.Save(path, error); }
+  {
+    auto lock = ReadLock_();
+    return table_.Save(path, error);
+  }
+
+  // Reads a copy of the size published after each update, without locking.
+  [[nodiscard]] size_t ApproxSize() const final {
+    return approx_size_.load(std::memory_order_relaxed);
+  }
+
+  void Reserve(size_t n) final {
     // scope-lock for mutual exclusion
-    std::scoped_lock<std::mutex> lock(mutex_);
+    auto lock = WriteLock_();
 
-    auto& bucket = Bucket_(elem);
+    table_.Reserve(n);
+    gate_.Advance();
+  }
 
-    // return if found or not
-    auto found = std::find(bucket.begin(), bucket.end(), elem) != bucket.end();
-    return found;
+  void ShrinkToFit() final {
+    // scope-lock for mutual exclusion
+    auto lock = WriteLock_();
+
+    table_.ShrinkToFit();
+    gate_.Advance();
   }
 
-  [[nodiscard]] size_t Size() const final {
+  // Reads the counters without the lock, so as not to disturb the set.
+  [[nodiscard]] SetStats Stats() const final {
+    SetStats stats;
+    table_.CollectStats(stats);
+    stats.helped_buckets = rehash_.HelpedBuckets();
+    CollectLockStats(stats, std::span(&mutex_, 1),
+                     [](const auto& padded) -> const Lock& {
+                       return padded.value;
+                     });
+    return stats;
+  }
+
+  // The batch operations hold the lock once for the whole batch, resizing
+  // inline whenever the policy asks for it.
+  std::vector<bool> AddAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+
+    // scope-lock for mutual exclusion
+    auto lock = WriteLock_();
+
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Add(elems[i], hash);
+      if (table_.NeedsResize()) {
+        Resize_();
+      }
+    });
+    PublishSize_();
+    return result;
+  }
+
+  std::vector<bool> RemoveAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+
     // scope-lock for mutual exclusion
-    std::scoped_lock<std::mutex> lock(mutex_);
+    auto lock = WriteLock_();
 
-    return set_size_;
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Remove(elems[i], hash);
+    });
+
+    // apply shrinking policy once the batch is done; a large batch may call
+    // for several steps
+    while (table_.NeedsShrink()) {
+      table_.Shrink();
+      gate_.Advance();
+    }
+    PublishSize_();
+    return result;
+  }
+
+  [[nodiscard]] std::vector<bool> ContainsAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+
+    // scope-lock, shared with other readers if possible
+    auto lock = ReadLock_();
+
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Contains(elems[i], hash);
+    });
+    return result;
   }
 
  private:
-  std::vector<std::vector<T>> table_;
-  size_t set_size_;  // tracks the number of elements in the table
-  std::hash<T> hasher_;
-  mutable std::mutex mutex_;
+  static constexpr bool kSharedReads = requires(Mutex& mutex) {
+    mutex.lock_shared();
+    mutex.unlock_shared();
+  };
+
+  static constexpr bool kParallelResize = requires(Table& table) {
+    requires Table::kParallelResize;
+    table.MigrateBuckets(table.BeginResize(), 0);
+    table.EndResize();
+  };
+
+  // |Mutex|, counting acquisitions and waits when built with HASH_SET_STATS
+  using Lock = StatsMutex<Mutex>;
+
+  Table table_;
+  // On a line of its own, so that threads contending for it do not keep
+  // invalidating |rehash_|, which waiting threads poll, or the size
+  // that ApproxSize() readers poll.
+  mutable CacheLinePadded<Lock> mutex_;
+  // splits the rehash of a growing table among the threads waiting on it
+  mutable CooperativeRehash rehash_;
+  // elects the thread that acts on a resize decided by Add()
+  ResizeGate gate_;
+  // copy of table_.Size() for lock-free readers, written only under |mutex_|
+  std::atomic<size_t> approx_size_{0};
+
+  std::vector<T> SnapshotElements_() final {
+    std::vector<T> elems;
+    // scope-lock, shared with other readers if possible
+    auto lock = ReadLock_();
+
+    elems.reserve(table_.Size());
+    table_.ForEach([&](const T& elem) { elems.push_back(elem); });
+    return elems;
+  }
+
+  void PublishSize_() {
+    approx_size_.store(table_.Size(), std::memory_order_relaxed);
+  }
 
   /**
-   * Returns the bucket associated with the element.
+   * Locks |mutex_| exclusively, helping instead of blocking while a rehash
+   * holds it.
    */
-  std::vector<T>& Bucket_(T elem) {
-    return table_[hasher_(elem) % table_.size()];
+  std::unique_lock<Lock> WriteLock_() const {
+    return LockHelping_<std::unique_lock<Lock>>();
   }
 
-  bool Policy_() { return set_size_ / table_.size() > 4; }
+  /**
+   * Locks |mutex_| for a read-only operation: in shared mode if |Mutex|
+   * supports it, and exclusively otherwise. Like WriteLock_(), helps instead
+   * of blocking while a rehash holds it.
+   */
+  auto ReadLock_() const {
+    if constexpr (kSharedReads) {
+      return LockHelping_<std::shared_lock<Lock>>();
+    } else {
+      return LockHelping_<std::unique_lock<Lock>>();
+    }
+  }
+
+  /**
+   * Takes |mutex_| through a |Guard|, std::unique_lock or std::shared_lock.
+   * Only a table that resizes in steps is ever rehashed with help, so other
+   * tables block in lock() as usual.
+   */
+  template <typename Guard>
+  Guard LockHelping_() const {
+    if constexpr (kParallelResize) {
+      Guard lock(mutex_.value, std::defer_lock);
+      rehash_.Acquire(lock);
+      return lock;
+    } else {
+      return Guard(mutex_.value);
+    }
+  }
+
+  template <typename U>
+  bool Add_(U&& elem) {
+    bool resize;
+    size_t generation;
+    {
+      // scope-lock for mutual exclusion
+      auto lock = WriteLock_();
+
+      // return false on duplicate, otherwise insert
+      if (!table_.Add(std::forward<U>(elem))) return false;
+      PublishSize_();
+
+      // evaluate the policy while the lock is still held, so that the lock is
+      // only taken again when a resize is actually due
+      resize = table_.NeedsResize();
+      generation = gate_.Generation();
+    }  // release lock
+
+    // apply resizing policy if needed, unless another thread already is
+    if (resize && gate_.TryBegin(generation)) {
+      ResizeIfNeeded_();
+      gate_.End();
+    }
+    return true;
+  }
+
+  template <typename Key>
+  bool Remove_(const Key& key) {
+    // scope-lock for mutual exclusion
+    auto lock = WriteLock_();
+
+    if (!table_.Remove(key)) return false;
+
+    // apply shrinking policy if needed; this is rare enough to do while still
+    // holding the lock
+    if (table_.NeedsShrink()) {
+      table_.Shrink();
+      gate_.Advance();
+    }
+    PublishSize_();
+    return true;
+  }
+
+  template <typename Key>
+  bool Contains_(const Key& key) {
+    // scope-lock, shared with other readers if possible
+    auto lock = ReadLock_();
+
+    return table_.Contains(key);
+  }
 
   void ResizeIfNeeded_() {
     // scope-lock for mutual exclusion
-    std::scoped_lock<std::mutex> lock(mutex_);
+    auto lock = WriteLock_();
 
-    // check if need to resize
-    if (!Policy_()) return;
+    // check again: a bulk operation may have resized the table since
+    if (!table_.NeedsResize()) return;
 
-    // 1) create a new empty table with double the number of buckets
-    std::vector<std::vector<T>> new_table(table_.size() * 2);
+    Resize_();
+  }
 
-    // 2) move elements from the old table to the new one
-    for (auto& bucket : table_) {
-      for (auto& elem : bucket) {
-        size_t i = hasher_(elem) % new_table.size();
-        new_table[i].push_back(std::move(elem));
-      }
+  /**
+   * Grows the table. The caller must hold |mutex_| exclusively.
+   */
+  void Resize_() {
+    if constexpr (kParallelResize) {
+      rehash_.Run(table_.BeginResize(), [this](size_t begin, size_t end) {
+        table_.MigrateBuckets(begin, end);
+      });
+      table_.EndResize();
+    } else {
+      table_.Resize();
     }
-
-    // 3) replace old table with new one
-    table_ = std::move(new_table);
+    gate_.Advance();
   }
 };
 
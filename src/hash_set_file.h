@@ -0,0 +1,75 @@
+#ifndef HASH_SET_FILE_H
+#define HASH_SET_FILE_H
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/util/set_file.h"
+
+// Writes the elements of |set| to |path| as a key array (see
+// src/util/set_file.h), in ascending order and as of one point in time, as
+// Snapshot() returns them. Returns false, describing the failure in |error|,
+// if writing fails.
+template <typename T>
+  requires std::is_trivially_copyable_v<T> && std::totally_ordered<T>
+bool SaveHashSet(HashSetBase<T>& set, const std::string& path,
+                 std::string& error) {
+  std::vector<T> elems = set.Snapshot();
+  SetFileHeader header;
+  header.kind = SetFileKind::kKeys;
+  header.record_size = sizeof(T);
+  header.count = elems.size();
+  return WriteSetFile(path, header, {std::as_bytes(std::span(elems))}, error);
+}
+
+// Adds every element of the key array at |path| to |set|. The set is grown
+// once up front to hold them all, so no resize runs while they go in; the
+// array is then read straight from a mapping of the file, split into
+// |threads| contiguous ranges that as many threads add concurrently.
+// |threads| must be 1 unless the set is thread-safe. Returns false, having
+// added nothing, and describes the failure in |error| if the file is not a
+// key array of T.
+//
+// Elements go in one Add() at a time rather than through AddAll(), which
+// would first copy and sort each batch by stripe for the striped sets, work
+// that adding the contiguous ranges directly does not need.
+template <typename T>
+  requires std::is_trivially_copyable_v<T>
+bool LoadHashSet(HashSetBase<T>& set, const std::string& path, size_t threads,
+                 std::string& error) {
+  MappedSetFile file;
+  std::span<const T> elems;
+  if (!file.Open(path, SetFileKind::kKeys, sizeof(T), error) ||
+      !file.Next(file.Header().count, elems, error)) {
+    return false;
+  }
+
+  set.Reserve(set.ApproxSize() + elems.size());
+
+  auto load = [&set, elems](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      (void)set.Add(elems[i]);
+    }
+  };
+  threads = std::clamp<size_t>(threads, 1, std::max<size_t>(elems.size(), 1));
+  std::vector<std::thread> workers;
+  size_t chunk = elems.size() / threads;
+  for (size_t t = 1; t < threads; t++) {
+    workers.emplace_back(load, t * chunk,
+                         t + 1 == threads ? elems.size() : (t + 1) * chunk);
+  }
+  load(0, threads == 1 ? elems.size() : chunk);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return true;
+}
+
+#endif  // HASH_SET_FILE_H
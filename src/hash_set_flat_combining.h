@@ -0,0 +1,373 @@
+#ifndef HASH_SET_FLAT_COMBINING_H
+#define HASH_SET_FLAT_COMBINING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/table/chained_table.h"
+#include "src/util/batch.h"
+#include "src/util/cache_line.h"
+#include "src/util/cooperative_rehash.h"
+#include "src/util/hash_policy.h"
+#include "src/util/set_stats.h"
+#include "src/util/thread_index.h"
+
+// The coarse-grained set, with operations delegated by flat combining (Hendler
+// et al., 2010). Rather than queueing for a held lock, a thread publishes its
+// Add, Remove or Contains in a slot of its own and keeps trying the lock.
+// Whichever thread gets it becomes the combiner: it runs every request
+// pending in the slots while the table is hot in its cache, and hands back
+// the results. The others watch their slots, and take the lock themselves
+// only if it is free and their request still waits. A thread that finds the
+// lock free to begin with runs its operation at once, and then combines.
+// Under contention a whole batch of operations then costs one lock handoff,
+// and the table's cache lines stay with one core, where plain |Mutex| handoff
+// moves them, and the lock, on every operation.
+//
+// |Table| and |Mutex| are as for HashSetCoarseGrained; the lock is only ever
+// taken exclusively. A combiner grows and shrinks the table inline, as the
+// batch operations do, and the threads waiting on their slots help migrate
+// its buckets if |Table| can resize in steps.
+//
+// A thread whose ThreadIndex() is beyond the slots, of which there are
+// several per hardware thread, runs its operations under the lock directly,
+// combining any pending requests while it holds it.
+template <typename T, typename Table = ChainedTable<T>,
+          typename Mutex = std::mutex>
+class HashSetFlatCombining : public HashSetBase<T> {
+ public:
+  explicit HashSetFlatCombining(const size_t capacity)
+      : table_(capacity),
+        requests_(std::max<size_t>(kMinSlots,
+                                   kSlotsPerThread *
+                                       std::thread::hardware_concurrency())) {
+    assert(capacity > 0);
+  }
+
+  bool Add(T&& elem) final { return Delegate_(&AddOp_<T&&>, &elem); }
+
+  bool Add(const T& elem) final {
+    return Delegate_(&AddOp_<const T&>, const_cast<T*>(&elem));
+  }
+
+  bool Remove(const T& elem) final { return Remove_(elem); }
+
+  [[nodiscard]] bool Contains(const T& elem) final { return Contains_(elem); }
+
+  // Lookups by a key that |Table|'s hasher accepts in place of a T.
+  template <TransparentKey<T, typename Table::hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove_(key);
+  }
+
+  template <TransparentKey<T, typename Table::hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) {
+    return Contains_(key);
+  }
+
+  // Copies the elements out under the lock and then calls |fn| without it, as
+  // the coarse-grained set does. The walk sees one point in time, and |fn| may
+  // update the set.
+  void ForEach(const std::function<void(const T&)>& fn) final {
+    for (const T& elem : SnapshotElements_()) fn(elem);
+  }
+
+  [[nodiscard]] size_t Size() const final {
+    // scope-lock for mutual exclusion
+    auto lock = Lock_();
+
+    return table_.Size();
+  }
+
+  // Reads a copy of the size published after each batch, without locking.
+  [[nodiscard]] size_t ApproxSize() const final {
+    return approx_size_.load(std::memory_order_relaxed);
+  }
+
+  void Reserve(size_t n) final {
+    // scope-lock for mutual exclusion
+    auto lock = Lock_();
+
+    table_.Reserve(n);
+  }
+
+  void ShrinkToFit() final {
+    // scope-lock for mutual exclusion
+    auto lock = Lock_();
+
+    table_.ShrinkToFit();
+  }
+
+  // Reads the counters without the lock, so as not to disturb the set. Each
+  // lock acquisition stands for a whole batch of combined operations.
+  [[nodiscard]] SetStats Stats() const final {
+    SetStats stats;
+    table_.CollectStats(stats);
+    stats.helped_buckets = rehash_.HelpedBuckets();
+    CollectLockStats(stats, std::span(&mutex_, 1),
+                     [](const auto& padded) -> const Lock& {
+                       return padded.value;
+                     });
+    return stats;
+  }
+
+  // The batch operations are already batches: they hold the lock once for
+  // the whole batch, as in the coarse-grained set, and then serve any
+  // requests that were published meanwhile.
+  std::vector<bool> AddAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+
+    // scope-lock for mutual exclusion
+    auto lock = Lock_();
+
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Add(elems[i], hash);
+      if (table_.NeedsResize()) {
+        Resize_();
+      }
+    });
+    Combine_();
+    return result;
+  }
+
+  std::vector<bool> RemoveAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+
+    // scope-lock for mutual exclusion
+    auto lock = Lock_();
+
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Remove(elems[i], hash);
+    });
+    while (table_.NeedsShrink()) {
+      table_.Shrink();
+    }
+    Combine_();
+    return result;
+  }
+
+  [[nodiscard]] std::vector<bool> ContainsAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+
+    // scope-lock for mutual exclusion
+    auto lock = Lock_();
+
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Contains(elems[i], hash);
+    });
+    Combine_();
+    return result;
+  }
+
+ private:
+  static constexpr bool kParallelResize = requires(Table& table) {
+    requires Table::kParallelResize;
+    table.MigrateBuckets(table.BeginResize(), 0);
+    table.EndResize();
+  };
+
+  static constexpr size_t kSlotsPerThread = 4;
+  static constexpr size_t kMinSlots = 64;
+  // a combiner rescans the slots while its last pass found requests, up to
+  // this many passes, so that it neither starves its own caller nor gives up
+  // the lock just as a new round of requests arrives
+  static constexpr size_t kMaxCombinePasses = 4;
+
+  // |Mutex|, counting acquisitions and waits when built with HASH_SET_STATS
+  using Lock = StatsMutex<Mutex>;
+
+  // Runs one request against the table, which the caller has locked;
+  // |operand| points at the caller's element or key.
+  using Operation = bool (*)(HashSetFlatCombining& set, void* operand);
+
+  enum RequestState : uint32_t { kIdle, kPending, kDone };
+
+  // A thread's publication slot. The operation and operand are written by
+  // the owning thread before it sets |state| to kPending; the result by the
+  // combiner before it sets |state| to kDone.
+  struct Request {
+    std::atomic<uint32_t> state{kIdle};
+    Operation operation = nullptr;
+    void* operand = nullptr;
+    bool result = false;
+    std::exception_ptr error;  // thrown by |operation|, if it threw
+  };
+
+  Table table_;
+  // Each slot has a cache line of its own, shared only between its owner and
+  // the combiner of the moment.
+  std::vector<CacheLinePadded<Request>> requests_;
+  // one past the highest slot published in so far, which bounds the scan
+  std::atomic<size_t> slots_in_use_{0};
+  // On a line of its own, so that threads trying it do not keep invalidating
+  // the slots or |rehash_|.
+  mutable CacheLinePadded<Lock> mutex_;
+  // splits the rehash of a growing table among the threads waiting on it
+  CooperativeRehash rehash_;
+  // copy of table_.Size() for lock-free readers, written only under |mutex_|
+  std::atomic<size_t> approx_size_{0};
+
+  std::vector<T> SnapshotElements_() final {
+    std::vector<T> elems;
+    // scope-lock for mutual exclusion
+    auto lock = Lock_();
+
+    elems.reserve(table_.Size());
+    table_.ForEach([&](const T& elem) { elems.push_back(elem); });
+    return elems;
+  }
+
+  /**
+   * Locks |mutex_| for an operation of the caller's own. Does not help with a
+   * rehash: only a combiner, which holds |mutex_|, runs one.
+   */
+  std::unique_lock<Lock> Lock_() const {
+    return std::unique_lock<Lock>(mutex_.value);
+  }
+
+  /**
+   * Publishes |operation| on |operand| in the calling thread's slot and waits
+   * until a combiner, possibly this thread, has run it. Rethrows whatever the
+   * operation threw.
+   */
+  bool Delegate_(Operation operation, void* operand) {
+    size_t slot = ThreadIndex();
+    if (slot >= requests_.size()) {
+      // no slot to publish in; serve ourselves, and others while at it
+      auto lock = Lock_();
+      return RunAndCombine_(operation, operand);
+    }
+    {
+      // uncontended, publishing would only add the slot's round trip
+      std::unique_lock<Lock> lock(mutex_.value, std::try_to_lock);
+      if (lock.owns_lock()) return RunAndCombine_(operation, operand);
+    }
+
+    Request& request = requests_[slot].value;
+    request.operation = operation;
+    request.operand = operand;
+    request.state.store(kPending, std::memory_order_release);
+    size_t in_use = slots_in_use_.load(std::memory_order_relaxed);
+    while (in_use <= slot && !slots_in_use_.compare_exchange_weak(
+                                 in_use, slot + 1, std::memory_order_relaxed)) {
+    }
+
+    // A combiner that scanned before the request was published misses it, so
+    // keep trying the lock until someone has served it.
+    while (request.state.load(std::memory_order_acquire) != kDone) {
+      std::unique_lock<Lock> lock(mutex_.value, std::try_to_lock);
+      if (lock.owns_lock()) {
+        Combine_();
+      } else {
+        rehash_.Help();
+        std::this_thread::yield();
+      }
+    }
+
+    bool result = request.result;
+    std::exception_ptr error = std::move(request.error);
+    request.state.store(kIdle, std::memory_order_relaxed);
+    if (error) std::rethrow_exception(error);
+    return result;
+  }
+
+  template <typename Key>
+  bool Remove_(const Key& key) {
+    return Delegate_(&RemoveOp_<Key>, const_cast<Key*>(&key));
+  }
+
+  template <typename Key>
+  bool Contains_(const Key& key) {
+    return Delegate_(&ContainsOp_<Key>, const_cast<Key*>(&key));
+  }
+
+  /**
+   * Runs the caller's own |operation| and then every pending request. The
+   * caller must hold |mutex_|.
+   */
+  bool RunAndCombine_(Operation operation, void* operand) {
+    bool result = operation(*this, operand);
+    Combine_();
+    return result;
+  }
+
+  /**
+   * Runs every pending request, as the combiner. The caller must hold
+   * |mutex_|.
+   */
+  void Combine_() {
+    for (size_t pass = 0; pass < kMaxCombinePasses; pass++) {
+      bool served = false;
+      size_t in_use = slots_in_use_.load(std::memory_order_relaxed);
+      for (size_t slot = 0; slot < in_use; slot++) {
+        Request& request = requests_[slot].value;
+        if (request.state.load(std::memory_order_acquire) != kPending) {
+          continue;
+        }
+        try {
+          request.result = request.operation(*this, request.operand);
+        } catch (...) {
+          request.error = std::current_exception();
+        }
+        request.state.store(kDone, std::memory_order_release);
+        served = true;
+      }
+      if (!served) break;
+    }
+    approx_size_.store(table_.Size(), std::memory_order_relaxed);
+  }
+
+  template <typename U>
+  static bool AddOp_(HashSetFlatCombining& set, void* operand) {
+    auto& elem = *static_cast<std::remove_reference_t<U>*>(operand);
+
+    // return false on duplicate, otherwise insert
+    if (!set.table_.Add(std::forward<U>(elem))) return false;
+
+    // apply resizing policy if needed; the combiner holds the lock already
+    if (set.table_.NeedsResize()) set.Resize_();
+    return true;
+  }
+
+  template <typename Key>
+  static bool RemoveOp_(HashSetFlatCombining& set, void* operand) {
+    if (!set.table_.Remove(*static_cast<const Key*>(operand))) return false;
+
+    // apply shrinking policy if needed
+    if (set.table_.NeedsShrink()) set.table_.Shrink();
+    return true;
+  }
+
+  template <typename Key>
+  static bool ContainsOp_(HashSetFlatCombining& set, void* operand) {
+    return set.table_.Contains(*static_cast<const Key*>(operand));
+  }
+
+  /**
+   * Grows the table. The caller must hold |mutex_|.
+   */
+  void Resize_() {
+    if constexpr (kParallelResize) {
+      rehash_.Run(table_.BeginResize(), [this](size_t begin, size_t end) {
+        table_.MigrateBuckets(begin, end);
+      });
+      table_.EndResize();
+    } else {
+      table_.Resize();
+    }
+  }
+};
+
+#endif  // HASH_SET_FLAT_COMBINING_H
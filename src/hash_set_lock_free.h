@@ -0,0 +1,393 @@
+#ifndef HASH_SET_LOCK_FREE_H
+#define HASH_SET_LOCK_FREE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+
+#include "src/hash_set_base.h"
+#include "src/reclaim/epoch.h"
+#include "src/util/hash_policy.h"
+#include "src/util/set_stats.h"
+
+// A lock-free hash set built as a split-ordered list (Shalev & Shavit). All
+// elements live in a single lock-free linked list (Michael's algorithm)
+// sorted by the bit-reversal of their hash. Each bucket is a pointer to a
+// sentinel node in that list, so doubling the bucket count only adds new
+// sentinels, which are spliced in lazily on first use; no element ever moves.
+// Every operation runs pinned in an EpochDomain, to which unlinked nodes are
+// retired, so that they are freed once no traversal can still reach them.
+//
+// Split ordering needs power-of-two bucket counts that double, so of |Policy|
+// only the maximum load is free to choose. The bucket count never shrinks,
+// since sentinels cannot be unlinked while other threads may be traversing
+// them; ShrinkToFit() is the default no-op.
+template <typename T, typename Hasher = std::hash<T>,
+          typename Policy = Pow2BucketPolicy>
+class HashSetLockFree : public HashSetBase<T> {
+  static_assert(Policy::kMasked && Policy::kGrowth == 2,
+                "split ordering needs doubling power-of-two bucket counts");
+
+ public:
+  explicit HashSetLockFree(const size_t capacity)
+      : bucket_count_(Policy::Buckets(capacity)) {
+    assert(capacity > 0);
+    // the sentinel of bucket 0 is the head of the whole list
+    head_ = new Node(SentinelKey_(0));
+    Slot_(0).store(head_);
+  }
+
+  HashSetLockFree(const HashSetLockFree&) = delete;
+  HashSetLockFree& operator=(const HashSetLockFree&) = delete;
+
+  ~HashSetLockFree() override {
+    // every node still linked, including logically deleted ones
+    Node* node = head_;
+    while (node != nullptr) {
+      Node* next = Ptr_(node->next.load());
+      Delete_(node);
+      node = next;
+    }
+    for (auto& segment : segments_) {
+      delete[] segment.load();
+    }
+    // nodes already unlinked are freed by |epoch_|
+  }
+
+  bool Add(T&& elem) final { return Add_(std::move(elem)); }
+
+  bool Add(const T& elem) final { return Add_(elem); }
+
+  bool Remove(const T& elem) final { return Remove_(elem); }
+
+  [[nodiscard]] bool Contains(const T& elem) final { return Contains_(elem); }
+
+  // Lookups by a key that |Hasher| accepts in place of a T.
+  template <TransparentKey<T, Hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove_(key);
+  }
+
+  template <TransparentKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) {
+    return Contains_(key);
+  }
+
+  [[nodiscard]] size_t Size() const final { return set_size_.load(); }
+
+  // Only publishes a larger bucket count, as growing does; the buckets are
+  // initialised by whoever first uses them.
+  void Reserve(size_t n) final {
+    size_t bucket_count = bucket_count_.load();
+    size_t wanted = std::min(Policy::Reserved(n, bucket_count), kTopBit);
+    while (bucket_count < wanted) {
+      if (bucket_count_.compare_exchange_weak(bucket_count, wanted)) {
+        stats_.RecordResize(0);
+        break;
+      }
+    }
+  }
+
+  // Walks the whole list under one pin, calling |fn| on every element not
+  // logically deleted when reached; a walk cannot resume after unpinning,
+  // since the node it stopped at may be freed. Updates overlapping the call
+  // may or may not be seen, and nodes retired meanwhile are freed only once
+  // it returns, so |fn| should be quick. |fn| may update the set.
+  void ForEach(const std::function<void(const T&)>& fn) final {
+    auto guard = epoch_.Pin();
+    for (Node* node = Ptr_(head_->next.load()); node != nullptr;) {
+      uintptr_t next = node->next.load();
+      if (IsRegular_(node->key) && !IsMarked_(next)) fn(Elem_(node));
+      node = Ptr_(next);
+    }
+  }
+
+  // There are no locks, so only searches and resizes are counted. Searches
+  // count the list nodes walked, bucket sentinels included.
+  [[nodiscard]] SetStats Stats() const final {
+    SetStats stats;
+    stats_.Collect(stats);
+    return stats;
+  }
+
+ private:
+  static_assert(sizeof(size_t) == 8, "split-order keys assume 64-bit size_t");
+
+  // the low bit of a successor link marks its node as logically deleted
+  static constexpr uintptr_t kMark = 1;
+  static constexpr size_t kTopBit = size_t{1} << 63;
+  // bucket b lives in segment bit_width(b), so 64 segments cover 2^63 buckets
+  static constexpr size_t kSegments = 64;
+
+  struct Node {
+    explicit Node(size_t k) : key(k), next(0) {}
+
+    const size_t key;             // split-order key
+    std::atomic<uintptr_t> next;  // successor, tagged with kMark
+  };
+
+  struct ElemNode : Node {
+    template <typename U>
+    ElemNode(size_t k, U&& e) : Node(k), elem(std::forward<U>(e)) {}
+
+    T elem;
+  };
+
+  Node* head_;
+  // Lazily allocated segments of the bucket index. Segment 0 holds bucket 0
+  // and segment s > 0 holds buckets [2^(s-1), 2^s). Segments are never
+  // reallocated, so growing the index never moves existing bucket pointers.
+  std::array<std::atomic<std::atomic<Node*>*>, kSegments> segments_{};
+  std::atomic<size_t> bucket_count_;  // always a power of two
+  // tracks the number of elements in the set
+  std::atomic<size_t> set_size_{0};
+  // frees unlinked nodes once no traversal can still reach them
+  EpochDomain epoch_;
+  Hasher hasher_;
+  [[no_unique_address]] StatsRecorder stats_;
+
+  static constexpr size_t Reverse_(size_t x) {
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    x = ((x >> 8) & 0x00FF00FF00FF00FFULL) | ((x & 0x00FF00FF00FF00FFULL) << 8);
+    x = ((x >> 16) & 0x0000FFFF0000FFFFULL) |
+        ((x & 0x0000FFFF0000FFFFULL) << 16);
+    return (x >> 32) | (x << 32);
+  }
+
+  /**
+   * Element keys are odd and sentinel keys are even, so a bucket's sentinel
+   * always sorts immediately before the elements hashed to it.
+   */
+  static constexpr size_t RegularKey_(size_t hash) {
+    return Reverse_(hash | kTopBit);
+  }
+
+  static constexpr size_t SentinelKey_(size_t bucket) {
+    return Reverse_(bucket);
+  }
+
+  static constexpr bool IsRegular_(size_t key) { return (key & 1) != 0; }
+
+  static bool IsMarked_(uintptr_t word) { return (word & kMark) != 0; }
+
+  static Node* Ptr_(uintptr_t word) {
+    return reinterpret_cast<Node*>(word & ~kMark);
+  }
+
+  static uintptr_t Word_(Node* node) {
+    return reinterpret_cast<uintptr_t>(node);
+  }
+
+  static const T& Elem_(Node* node) {
+    return static_cast<ElemNode*>(node)->elem;
+  }
+
+  static void Delete_(Node* node) {
+    if (IsRegular_(node->key)) {
+      delete static_cast<ElemNode*>(node);
+    } else {
+      delete node;
+    }
+  }
+
+  template <typename U>
+  bool Add_(U&& elem) {
+    size_t hash = hasher_(elem);
+    auto guard = epoch_.Pin();
+    size_t bucket_count = bucket_count_.load();
+    Node* start = BucketHead_(Policy::Index(hash, bucket_count));
+
+    // 3) return false on duplicate, otherwise link the new node in
+    auto* node = new ElemNode(RegularKey_(hash), std::forward<U>(elem));
+    if (Insert_(start, node, &node->elem) != node) {
+      delete node;
+      return false;
+    }
+
+    // 4) update size
+    size_t size = ++set_size_;
+
+    // 5) apply resizing policy if needed; this only publishes a larger bucket
+    //    count, the new buckets are initialised by whoever first uses them
+    if (Policy::NeedsResize(size, bucket_count) &&
+        bucket_count < kTopBit &&
+        bucket_count_.compare_exchange_strong(bucket_count,
+                                              Policy::Grow(bucket_count))) {
+      // doubling is instantaneous, so it counts as a resize of no duration
+      stats_.RecordResize(0);
+    }
+    return true;
+  }
+
+  template <typename Key>
+  bool Remove_(const Key& elem) {
+    size_t hash = hasher_(elem);
+    auto guard = epoch_.Pin();
+    Node* start = BucketHead_(Policy::Index(hash, bucket_count_.load()));
+    size_t key = RegularKey_(hash);
+
+    std::atomic<uintptr_t>* prev;
+    Node* curr;
+    while (true) {
+      // find element position (returning early if doesn't exist)
+      if (!Find_(start, key, &elem, prev, curr)) return false;
+
+      // logically delete by marking the successor link; on failure another
+      // thread changed the successor or removed the node, so search again
+      uintptr_t next = curr->next.load();
+      if (IsMarked_(next) ||
+          !curr->next.compare_exchange_strong(next, next | kMark)) {
+        continue;
+      }
+      set_size_--;
+
+      // physically unlink; if that races, a fresh search unlinks it for us
+      uintptr_t expected = Word_(curr);
+      if (prev->compare_exchange_strong(expected, next)) {
+        Retire_(curr);
+      } else {
+        Find_(start, key, &elem, prev, curr);
+      }
+      return true;
+    }
+  }
+
+  template <typename Key>
+  bool Contains_(const Key& elem) {
+    size_t hash = hasher_(elem);
+    auto guard = epoch_.Pin();
+    Node* curr = BucketHead_(Policy::Index(hash, bucket_count_.load()));
+    size_t key = RegularKey_(hash);
+
+    // read-only traversal: marked nodes are skipped rather than unlinked, so
+    // lookups write to no shared memory beyond pinning
+    size_t walked = 0;
+    while (curr != nullptr && curr->key <= key) {
+      uintptr_t next = curr->next.load();
+      walked++;
+      if (curr->key == key && !IsMarked_(next) && Elem_(curr) == elem) {
+        stats_.RecordProbe(walked);
+        return true;
+      }
+      curr = Ptr_(next);
+    }
+    stats_.RecordProbe(walked);
+    return false;
+  }
+
+  /**
+   * Returns the bucket index slot for |bucket|, allocating its segment if
+   * needed.
+   */
+  std::atomic<Node*>& Slot_(size_t bucket) {
+    auto s = static_cast<size_t>(std::bit_width(bucket));
+    size_t base = s == 0 ? 0 : size_t{1} << (s - 1);
+    auto* segment = segments_[s].load();
+    if (segment == nullptr) {
+      auto* fresh = new std::atomic<Node*>[s == 0 ? 1 : base]();
+      if (segments_[s].compare_exchange_strong(segment, fresh)) {
+        segment = fresh;
+      } else {
+        delete[] fresh;
+      }
+    }
+    return segment[bucket - base];
+  }
+
+  /**
+   * Returns the sentinel of |bucket|, initialising it (and, recursively, its
+   * parent buckets) on first use.
+   */
+  Node* BucketHead_(size_t bucket) {
+    auto& slot = Slot_(bucket);
+    Node* head = slot.load();
+    if (head != nullptr) return head;
+
+    // a bucket is split from the one obtained by clearing its top bit, and
+    // its sentinel is inserted starting from that parent's sentinel
+    Node* parent = BucketHead_(bucket ^ std::bit_floor(bucket));
+    auto* sentinel = new Node(SentinelKey_(bucket));
+    head = Insert_(parent, sentinel, nullptr);
+    if (head != sentinel) delete sentinel;
+    slot.store(head);
+    return head;
+  }
+
+  /**
+   * Searches the list from |start| for the node with |key| and, for element
+   * keys, an element equal to |*elem|, which is a T or a key compared with
+   * one. On return |curr| is the matching node or the first node ordered after
+   * it, and |prev| is the unmarked link that pointed to |curr|. Marked nodes
+   * met on the way are unlinked and retired.
+   */
+  template <typename Key>
+  bool Find_(Node* start, size_t key, const Key* elem,
+             std::atomic<uintptr_t>*& prev, Node*& curr) {
+    size_t walked = 0;
+    while (true) {
+      prev = &start->next;
+      curr = Ptr_(prev->load());
+      bool retry = false;
+      while (curr != nullptr && !retry) {
+        uintptr_t next = curr->next.load();
+        walked++;
+        if (prev->load() != Word_(curr)) {
+          // prev was changed or marked under us: restart from |start|
+          retry = true;
+        } else if (IsMarked_(next)) {
+          // curr was logically deleted: help unlink it
+          uintptr_t expected = Word_(curr);
+          if (prev->compare_exchange_strong(expected, next & ~kMark)) {
+            Retire_(curr);
+            curr = Ptr_(next);
+          } else {
+            retry = true;
+          }
+        } else {
+          if (curr->key > key) break;
+          if (curr->key == key && (elem == nullptr || Elem_(curr) == *elem)) {
+            stats_.RecordProbe(walked);
+            return true;
+          }
+          prev = &curr->next;
+          curr = Ptr_(next);
+        }
+      }
+      if (!retry) {
+        stats_.RecordProbe(walked);
+        return false;
+      }
+    }
+  }
+
+  /**
+   * Links |node| into the list after |start| unless an equal node is already
+   * present. Returns the node that ends up in the list.
+   */
+  Node* Insert_(Node* start, Node* node, const T* elem) {
+    std::atomic<uintptr_t>* prev;
+    Node* curr;
+    while (true) {
+      if (Find_(start, node->key, elem, prev, curr)) return curr;
+      node->next.store(Word_(curr));
+      uintptr_t expected = Word_(curr);
+      if (prev->compare_exchange_strong(expected, Word_(node))) return node;
+    }
+  }
+
+  /**
+   * Retires an unlinked node. Exactly one thread succeeds in unlinking each
+   * node, so each node is retired once.
+   */
+  void Retire_(Node* node) {
+    epoch_.Retire(node, [](void* p) { Delete_(static_cast<Node*>(p)); });
+  }
+};
+
+#endif  // HASH_SET_LOCK_FREE_H
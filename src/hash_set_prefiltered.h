@@ -0,0 +1,306 @@
+#ifndef HASH_SET_PREFILTERED_H
+#define HASH_SET_PREFILTERED_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/reclaim/epoch.h"
+#include "src/util/bloom_filter.h"
+#include "src/util/hash_policy.h"
+#include "src/util/set_stats.h"
+
+// A front-end that keeps a CountingBloomFilter of the elements of |Inner| (any
+// of the sets here), hashed by |Hasher| and mixed. Contains and ContainsAll
+// consult it first and answer a definite miss without touching |Inner|, its
+// table or its locks; lookups of elements that may be present, and all
+// updates, go on to |Inner|. The filter is read and updated without locks,
+// and published through an atomic pointer pinned in an EpochDomain.
+//
+// An element is counted into the filter before it is added to |Inner| and
+// counted out after it is removed, so the filter never misses an element a
+// lookup could find. When |Inner| outgrows the filter, one thread builds a
+// filter twice the size from a ForEach() over |Inner| while the others carry
+// on, counting their additions into both filters; removals are left out of
+// the new filter until it replaces the old one, as the walk may or may not
+// have counted the element. Reserve() and ShrinkToFit() rebuild it for the
+// new size, the latter also clearing the counts that removals left behind.
+//
+// Every operation pins the domain, which costs about as much as taking an
+// uncontended lock, and updates also touch the filter's line. The filter pays
+// for itself where misses are common and |Inner|'s locks are contended or its
+// table is out of cache, where a miss answered by the filter costs one line.
+//
+// Operations are as consistent as |Inner|'s, and Contains is linearizable if
+// |Inner|'s is.
+template <typename Inner,
+          typename Hasher = std::hash<typename Inner::value_type>>
+class HashSetPrefiltered : public HashSetBase<typename Inner::value_type> {
+  using T = typename Inner::value_type;
+
+ public:
+  explicit HashSetPrefiltered(const size_t capacity)
+      : inner_(capacity),
+        filter_(new CountingBloomFilter(capacity)),
+        filter_capacity_(filter_.load()->Capacity()) {
+    assert(capacity > 0);
+  }
+
+  HashSetPrefiltered(const HashSetPrefiltered&) = delete;
+  HashSetPrefiltered& operator=(const HashSetPrefiltered&) = delete;
+
+  ~HashSetPrefiltered() override { delete filter_.load(); }
+
+  bool Add(T&& elem) final {
+    return Add_(elem, [&] { return inner_.Add(std::move(elem)); });
+  }
+
+  bool Add(const T& elem) final {
+    return Add_(elem, [&] { return inner_.Add(elem); });
+  }
+
+  bool Remove(const T& elem) final { return Remove_(elem); }
+
+  [[nodiscard]] bool Contains(const T& elem) final { return Contains_(elem); }
+
+  // Lookups by a key that |Hasher|, and |Inner|'s hasher, accept in place of
+  // a T.
+  template <TransparentKey<T, Hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove_(key);
+  }
+
+  template <TransparentKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) {
+    return Contains_(key);
+  }
+
+  void ForEach(const std::function<void(const T&)>& fn) final {
+    inner_.ForEach(fn);
+  }
+
+  [[nodiscard]] size_t Size() const final { return inner_.Size(); }
+
+  [[nodiscard]] size_t ApproxSize() const final { return inner_.ApproxSize(); }
+
+  void Reserve(size_t n) final {
+    inner_.Reserve(n);
+    if (n > filter_capacity_.load(std::memory_order_relaxed)) Rebuild_(n);
+  }
+
+  void ShrinkToFit() final {
+    inner_.ShrinkToFit();
+    Rebuild_(inner_.ApproxSize());
+  }
+
+  [[nodiscard]] SetStats Stats() const final { return inner_.Stats(); }
+
+  // The batch operations filter the batch as a whole: additions are counted
+  // in before the batch goes to |Inner|, and lookups pass on only the
+  // elements that may be present.
+  std::vector<bool> AddAll(std::span<const T> elems) final {
+    std::vector<bool> result;
+    {
+      auto guard = epoch_.Pin();
+      auto filters = Filters_();
+      for (const T& elem : elems) filters.Insert(Hash_(elem));
+
+      result = inner_.AddAll(elems);
+
+      // count the duplicates out again
+      for (size_t i = 0; i < elems.size(); i++) {
+        if (!result[i]) filters.Erase(Hash_(elems[i]));
+      }
+    }  // unpin before a rebuild, which waits for pinned threads
+    RebuildIfNeeded_();
+    return result;
+  }
+
+  std::vector<bool> RemoveAll(std::span<const T> elems) final {
+    auto guard = epoch_.Pin();
+    auto filters = Filters_();
+    std::vector<bool> result = inner_.RemoveAll(elems);
+    for (size_t i = 0; i < elems.size(); i++) {
+      if (result[i]) filters.current->Erase(Hash_(elems[i]));
+    }
+    return result;
+  }
+
+  [[nodiscard]] std::vector<bool> ContainsAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+    std::vector<size_t> maybe;
+    std::vector<T> lookups;
+    {
+      auto guard = epoch_.Pin();
+      const auto& filter = Filter_();
+      for (size_t i = 0; i < elems.size(); i++) {
+        if (filter.MayContain(Hash_(elems[i]))) maybe.push_back(i);
+      }
+    }
+    if (maybe.empty()) return result;
+    if (maybe.size() == elems.size()) return inner_.ContainsAll(elems);
+
+    lookups.reserve(maybe.size());
+    for (size_t i : maybe) lookups.push_back(elems[i]);
+    auto found = inner_.ContainsAll(std::span<const T>(lookups));
+    for (size_t j = 0; j < maybe.size(); j++) {
+      result[maybe[j]] = found[j];
+    }
+    return result;
+  }
+
+ private:
+  // The filters an update must count itself into: the current one, and the
+  // one being built to replace it, if any.
+  struct Filters {
+    CountingBloomFilter* current;
+    CountingBloomFilter* next;  // null unless a rebuild is under way
+
+    void Insert(uint64_t hash) const {
+      current->Insert(hash);
+      if (next != nullptr) next->Insert(hash);
+    }
+
+    void Erase(uint64_t hash) const {
+      current->Erase(hash);
+      if (next != nullptr) next->Erase(hash);
+    }
+  };
+
+  Inner inner_;
+  // The filter of the elements of |inner_|, replaced on every rebuild. Read
+  // while pinned in |epoch_|.
+  std::atomic<CountingBloomFilter*> filter_;
+  // copy of the current filter's Capacity(), read without pinning
+  std::atomic<size_t> filter_capacity_;
+  // the filter being built to replace |filter_|, or null
+  std::atomic<CountingBloomFilter*> next_filter_{nullptr};
+  // elects the thread that rebuilds the filter
+  std::atomic<bool> rebuilding_{false};
+  // frees the filters that rebuilds replace once no thread can be reading
+  // them, and lets a rebuild wait out updates that missed the new filter
+  EpochDomain epoch_;
+  Hasher hasher_;
+
+  template <typename Key>
+  uint64_t Hash_(const Key& key) const {
+    return Mix64(static_cast<uint64_t>(hasher_(key)));
+  }
+
+  std::vector<T> SnapshotElements_() final {
+    if constexpr (std::totally_ordered<T>) {
+      return inner_.Snapshot();
+    } else {
+      return HashSetBase<T>::SnapshotElements_();
+    }
+  }
+
+  /**
+   * Returns the current filter. The caller must be pinned.
+   */
+  const CountingBloomFilter& Filter_() const { return *filter_.load(); }
+
+  /**
+   * Returns the filters that an update must count itself into. The caller
+   * must be pinned, and stay pinned until it has updated |inner_| and the
+   * filters, so that a rebuild cannot start walking before it is done.
+   */
+  Filters Filters_() const {
+    // Load the filter being built first: a rebuild replaces |filter_| before
+    // it clears |next_filter_|, so seeing no new filter and then the old
+    // current one means that the rebuild had not begun, and will wait for
+    // us. Loaded the other way round, both could be missed.
+    auto* next = next_filter_.load();
+    auto* current = filter_.load();
+    return {current, next == current ? nullptr : next};
+  }
+
+  template <typename Add>
+  bool Add_(const T& elem, Add add) {
+    uint64_t hash = Hash_(elem);
+    {
+      auto guard = epoch_.Pin();
+      auto filters = Filters_();
+      // count the element in first, so that no lookup can find it in
+      // |inner_| and then miss it in the filter
+      filters.Insert(hash);
+      if (!add()) {
+        filters.Erase(hash);
+        return false;
+      }
+    }  // unpin before a rebuild, which waits for pinned threads
+    RebuildIfNeeded_();
+    return true;
+  }
+
+  template <typename Key>
+  bool Remove_(const Key& key) {
+    auto guard = epoch_.Pin();
+    auto filters = Filters_();
+    if (!inner_.Remove(key)) return false;
+
+    // Count the element out of the current filter only: a filter being built
+    // counted it only if the walk over |inner_| reached it first.
+    filters.current->Erase(Hash_(key));
+    return true;
+  }
+
+  template <typename Key>
+  bool Contains_(const Key& key) {
+    {
+      auto guard = epoch_.Pin();
+      if (!Filter_().MayContain(Hash_(key))) return false;
+    }
+    return inner_.Contains(key);
+  }
+
+  /**
+   * Rebuilds the filter at twice its size, or more after a large batch, once
+   * |inner_| holds more elements than it was sized for. Must not be called
+   * while pinned.
+   */
+  void RebuildIfNeeded_() {
+    size_t capacity = filter_capacity_.load(std::memory_order_relaxed);
+    size_t size = inner_.ApproxSize();
+    if (size > capacity) Rebuild_(std::max(2 * capacity, size));
+  }
+
+  /**
+   * Replaces the filter with one for |capacity| elements built from |inner_|,
+   * unless another thread is rebuilding it already. Must not be called while
+   * pinned.
+   */
+  void Rebuild_(size_t capacity) {
+    // read first, so that additions arriving during a rebuild share the line
+    if (rebuilding_.load(std::memory_order_relaxed) ||
+        rebuilding_.exchange(true)) {
+      return;
+    }
+
+    // 1) publish the new filter to updates, and wait for those that may have
+    //    missed it to finish; every later addition counts itself into it
+    auto* next = new CountingBloomFilter(capacity);
+    next_filter_.store(next);
+    epoch_.Barrier();
+
+    // 2) count in every element present throughout the walk
+    inner_.ForEach([&](const T& elem) { next->Insert(Hash_(elem)); });
+
+    // 3) then replace the old filter with it
+    auto* old = filter_.exchange(next);
+    filter_capacity_.store(next->Capacity(), std::memory_order_relaxed);
+    next_filter_.store(nullptr);
+    epoch_.Retire(old);
+    rebuilding_.store(false);
+  }
+};
+
+#endif  // HASH_SET_PREFILTERED_H
@@ -0,0 +1,15 @@
+#ifndef HASH_SET_READER_WRITER_H
+#define HASH_SET_READER_WRITER_H
+
+#include <shared_mutex>
+
+#include "src/hash_set_coarse_grained.h"
+#include "src/table/chained_table.h"
+
+// The coarse-grained set guarded by a reader-writer lock: lookups share the
+// lock with each other and only writers and rehashing exclude everyone. Suits
+// read-heavy workloads with many threads.
+template <typename T, typename Table = ChainedTable<T>>
+using HashSetReaderWriter = HashSetCoarseGrained<T, Table, std::shared_mutex>;
+
+#endif  // HASH_SET_READER_WRITER_H
@@ -1,33 +1,566 @@
 #ifndef HASH_SET_REFINABLE_H
 #define HASH_SET_REFINABLE_H
 
+#include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
 
 #include "src/hash_set_base.h"
+#include "src/reclaim/epoch.h"
+#include "src/util/arena.h"
+#include "src/util/batch.h"
+#include "src/util/cache_line.h"
+#include "src/util/cooperative_rehash.h"
+#include "src/util/hash_policy.h"
+#include "src/util/prefetch.h"
+#include "src/util/rcu_bucket.h"
+#include "src/util/resize_gate.h"
+#include "src/util/set_stats.h"
+#include "src/util/sharded_counter.h"
 
-template <typename T>
+// |Hasher| and |Policy| are as for ChainedTable. |Allocator| provides the
+// bucket storage. Buckets under different locks are updated concurrently, so
+// an arena must be thread-safe, such as ArenaAllocator<T, ShardedArena>.
+// |kPadBuckets| and |Mutex|, the type of the bucket locks, are as for
+// HashSetStriped.
+//
+// Contains and ContainsAll take no locks and do not wait for a resize, as in
+// HashSetStriped: they search RcuBuckets of the table published last, while
+// pinned in an EpochDomain.
+template <typename T, typename Hasher = std::hash<T>,
+          typename Policy = DefaultBucketPolicy,
+          typename Allocator = std::allocator<T>, bool kPadBuckets = false,
+          typename Mutex = std::mutex>
 class HashSetRefinable : public HashSetBase<T> {
  public:
-  explicit HashSetRefinable(size_t /*initial_capacity*/) {}
+  explicit HashSetRefinable(const size_t capacity)
+      : table_(new BucketArray<Bucket>(MakeBuckets<Bucket>(
+            Policy::Buckets(capacity), arena_.allocator()))),
+        min_buckets_(Table_().size()) {
+    assert(capacity > 0);
+    locks_.store(new LockArray(Table_().size()));
+  }
+
+  HashSetRefinable(const HashSetRefinable&) = delete;
+  HashSetRefinable& operator=(const HashSetRefinable&) = delete;
 
-  bool Add(T /*elem*/) final {
-    assert(false && "Not implemented yet");
-    return false;
+  ~HashSetRefinable() override {
+    delete table_.load();
+    delete locks_.load();
   }
 
-  bool Remove(T /*elem*/) final {
-    assert(false && "Not implemented yet");
-    return false;
+  bool Add(T&& elem) final { return Add_(std::move(elem)); }
+
+  bool Add(const T& elem) final { return Add_(elem); }
+
+  bool Remove(const T& elem) final { return Remove_(elem); }
+
+  [[nodiscard]] bool Contains(const T& elem) final { return Contains_(elem); }
+
+  // Lookups by a key that |Hasher| accepts in place of a T.
+  template <TransparentKey<T, Hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove_(key);
   }
 
-  [[nodiscard]] bool Contains(T /*elem*/) final {
-    assert(false && "Not implemented yet");
-    return false;
+  template <TransparentKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) {
+    return Contains_(key);
   }
 
   [[nodiscard]] size_t Size() const final {
-    assert(false && "Not implemented yet");
-    return 0u;
+    // stop the world as a resize does, so that no update is in flight while
+    // the shards are summed
+    AcquireOwnership_();
+    Quiesce_();
+    size_t size = set_size_.Sum();
+    owner_.store(std::thread::id());
+    return size;
+  }
+
+  [[nodiscard]] size_t ApproxSize() const final { return set_size_.Approx(); }
+
+  void Reserve(size_t n) final {
+    // stop the world, waiting for any resize in progress to finish
+    AcquireOwnership_();
+    Quiesce_();
+
+    size_t buckets = Policy::Reserved(n, Table_().size());
+    if (buckets != Table_().size()) Rebuild_(buckets);
+
+    owner_.store(std::thread::id());
+  }
+
+  void ShrinkToFit() final {
+    // stop the world, which also makes the size exact
+    AcquireOwnership_();
+    Quiesce_();
+
+    // always rebuild, so that an arena holding freed buckets is released too
+    Rebuild_(Policy::Fitted(set_size_.Sum(), Table_().size(), min_buckets_),
+             /*fit=*/true);
+
+    owner_.store(std::thread::id());
+  }
+
+  std::vector<bool> AddAll(std::span<const T> elems) final {
+    return Batch_(elems, [this](Bucket& bucket, const T& elem,
+                                  size_t hash) {
+      if (!bucket.Add(elem, hash, epoch_)) return false;
+      set_size_.Increment();
+      return true;
+    });
+  }
+
+  std::vector<bool> RemoveAll(std::span<const T> elems) final {
+    return Batch_(elems, [this](Bucket& bucket, const T& elem,
+                                  size_t hash) {
+      if (!bucket.Remove(elem, hash, epoch_)) return false;
+      set_size_.Decrement();
+      return true;
+    });
+  }
+
+  // Like Contains, takes no locks; the whole batch runs under one pin against
+  // one version of the table.
+  [[nodiscard]] std::vector<bool> ContainsAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+    std::vector<size_t> hashes(elems.size());
+    for (size_t i = 0; i < elems.size(); i++) {
+      hashes[i] = hasher_(elems[i]);
+    }
+
+    auto guard = epoch_.Pin();
+    const auto& table = *table_.load();
+    for (size_t i = 0; i < elems.size(); i++) {
+      PrefetchAhead(i, elems.size(), [&](size_t j) -> const Bucket& {
+        return table[Policy::Index(hashes[j], table.size())];
+      });
+      const auto& bucket = table[Policy::Index(hashes[i], table.size())];
+      stats_.RecordSearch(bucket);
+      result[i] = bucket.Contains(elems[i], hashes[i]);
+    }
+    return result;
+  }
+
+  // Takes no locks, walking the set as HashSetStriped does. The lock count
+  // follows the bucket count, so the buckets are walked in the groups that
+  // share an index among the |min_buckets_| of the initial table; an
+  // element's group depends only on its hash, since every table size is a
+  // whole multiple of that.
+  void ForEach(const std::function<void(const T&)>& fn) final {
+    std::vector<T> batch;
+    for (size_t group = 0; group < min_buckets_; group++) {
+      {
+        auto guard = epoch_.Pin();
+        const auto& table = *table_.load();
+        for (size_t b = group; b < table.size(); b += min_buckets_) {
+          table[b].ReaderForEach([&](const typename Bucket::Slot& slot) {
+            batch.push_back(Bucket::Slots::Elem(slot));
+          });
+        }
+      }  // unpin
+      for (const T& elem : batch) fn(elem);
+      batch.clear();
+    }
+  }
+
+  // Reads the counters without stopping the world, so as not to disturb the
+  // set. The per-lock counts are those of the current lock array; the totals
+  // also hold those of every array a resize replaced, and may be slightly off
+  // while one is under way.
+  [[nodiscard]] SetStats Stats() const final {
+    SetStats stats;
+    stats_.Collect(stats);
+    stats.helped_buckets = rehash_.HelpedBuckets();
+    auto guard = epoch_.Pin();
+    CollectLockStats(stats, *locks_.load(),
+                     [](const auto& padded) -> const Lock& {
+                       return padded.value;
+                     });
+    return stats;
+  }
+
+ private:
+  // counts acquisitions and waits when built with HASH_SET_STATS
+  using Lock = StatsMutex<Mutex>;
+
+  using LockArray = std::vector<CacheLinePadded<Lock>>;
+
+  using Bucket = RcuBucket<T, Allocator, kPadBuckets>;
+
+  // declared before |table_|, which it must outlive
+  [[no_unique_address]] TableArena<Allocator> arena_;
+  // The current table, replaced on every rebuild. Writers read it under a
+  // bucket lock; lookups read it while pinned in |epoch_|.
+  std::atomic<BucketArray<Bucket>*> table_;
+  size_t min_buckets_;  // the bucket count at construction
+  // The current lock array, with exactly one lock per bucket. It is replaced
+  // on every resize so that the number of locks follows the number of buckets.
+  // Threads in Acquire_() may still be using a superseded array, so it is
+  // retired to |epoch_| rather than freed.
+  std::atomic<LockArray*> locks_;
+  // The thread currently resizing the table (or taking an exact Size()), or a
+  // default-constructed id if there is none. Setting it acts as the "resizing"
+  // mark that stops other threads from acquiring bucket locks.
+  mutable std::atomic<std::thread::id> owner_;
+  // tracks the number of elements in the table, sharded to avoid contention
+  ShardedCounter set_size_;
+  // splits the rehash of a growing table among the threads waiting on it
+  CooperativeRehash rehash_;
+  // elects the thread that acts on a resize the policy calls for
+  ResizeGate gate_;
+  // frees what writers replace once no lookup can still be reading it;
+  // mutable, since Stats() pins it too
+  mutable EpochDomain epoch_;
+  Hasher hasher_;
+  // lookups record their searches, hence mutable
+  [[no_unique_address]] mutable StatsRecorder stats_;
+
+  /**
+   * Returns the current table. The caller must hold a bucket lock or own the
+   * resize.
+   */
+  BucketArray<Bucket>& Table_() const {
+    return *table_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Locks the bucket associated with the hash and returns the held lock.
+   * Blocks while another thread is resizing the table.
+   */
+  std::unique_lock<Lock> Acquire_(size_t hash) {
+    const auto me = std::this_thread::get_id();
+    while (true) {
+      // 1) wait until no other thread is resizing
+      auto who = owner_.load();
+      while (who != std::thread::id() && who != me) {
+        rehash_.Help();
+        std::this_thread::yield();
+        who = owner_.load();
+      }
+
+      // 2) lock the bucket in the current lock array, pinned so that the
+      //    array outlives its use here even if a resize replaces it. Only the
+      //    current array's locks are ever held beyond this, as a resize
+      //    quiesces them before replacing it
+      auto guard = epoch_.Pin();
+      auto* old_locks = locks_.load();
+      std::unique_lock<Lock> lock(
+          (*old_locks)[Policy::Index(hash, old_locks->size())].value);
+
+      // 3) keep the lock only if no resize started in the meantime and the
+      //    lock array was not replaced under us; otherwise release and retry
+      who = owner_.load();
+      if ((who == std::thread::id() || who == me) &&
+          locks_.load() == old_locks) {
+        return lock;
+      }
+    }
+  }
+
+  /**
+   * Returns the bucket associated with the hash, recording its search. The
+   * caller must hold the corresponding bucket lock.
+   */
+  Bucket& Bucket_(size_t hash) {
+    auto& bucket = Table_()[Policy::Index(hash, Table_().size())];
+    stats_.RecordSearch(bucket);
+    return bucket;
+  }
+
+  template <typename U>
+  bool Add_(U&& elem) {
+    size_t hash = hasher_(elem);
+    size_t old_capacity;
+    size_t generation;
+    bool resize;
+    {
+      // lock the bucket, waiting out any resize in progress
+      auto lock = Acquire_(hash);
+
+      // 3) return false on duplicate, otherwise insert and update size
+      if (!Bucket_(hash).Add(std::forward<U>(elem), hash, epoch_)) return false;
+      set_size_.Increment();
+
+      // the table cannot be resized while we hold a bucket lock, so this
+      // snapshot of the capacity and generation is consistent with the policy
+      // check
+      old_capacity = Table_().size();
+      generation = gate_.Generation();
+      resize = Policy_(old_capacity);
+    }  // release lock
+
+    // 5) apply resizing policy if needed
+    if (resize) {
+      Resize_(generation, old_capacity, Policy::Grow(old_capacity));
+    }
+    return true;
+  }
+
+  template <typename Key>
+  bool Remove_(const Key& key) {
+    size_t hash = hasher_(key);
+    size_t old_capacity;
+    size_t generation;
+    bool shrink;
+    {
+      // lock the bucket, waiting out any resize in progress
+      auto lock = Acquire_(hash);
+
+      // remove element (returning early if doesn't exist) & decrement size
+      if (!Bucket_(hash).Remove(key, hash, epoch_)) return false;
+      set_size_.Decrement();
+
+      old_capacity = Table_().size();
+      generation = gate_.Generation();
+      shrink = ShrinkPolicy_(old_capacity);
+    }  // release lock
+
+    // apply shrinking policy if needed
+    if (shrink) {
+      Resize_(generation, old_capacity, Policy::Shrink(old_capacity));
+    }
+    return true;
+  }
+
+  template <typename Key>
+  bool Contains_(const Key& key) {
+    size_t hash = hasher_(key);
+
+    // no lock, and no waiting for a resize: the table and bucket read here
+    // stay allocated while pinned
+    auto guard = epoch_.Pin();
+    const auto& table = *table_.load();
+    const auto& bucket = table[Policy::Index(hash, table.size())];
+    stats_.RecordSearch(bucket);
+
+    // return if found or not
+    return bucket.Contains(key, hash);
+  }
+
+  bool Policy_(size_t capacity) {
+    return Policy::NeedsResize(set_size_.Approx(), capacity);
+  }
+
+  bool ShrinkPolicy_(size_t capacity) {
+    return Policy::NeedsShrink(set_size_.Approx(), capacity, min_buckets_);
+  }
+
+  /**
+   * Returns the number of locks in the current lock array.
+   */
+  size_t LockCount_() {
+    auto guard = epoch_.Pin();
+    return locks_.load()->size();
+  }
+
+  /**
+   * Applies |op(bucket, elem, hash)| to every element of the batch, taking each
+   * bucket lock once for all of the batch's elements under it. Elements are
+   * grouped against the current number of locks; if a resize changes it part
+   * way through, the remaining elements are regrouped.
+   */
+  template <typename Op>
+  std::vector<bool> Batch_(std::span<const T> elems, Op op) {
+    std::vector<bool> result(elems.size());
+    size_t grouped_with = LockCount_();
+    auto entries = GroupByStripe<Policy>(elems, hasher_, grouped_with);
+
+    for (size_t begin = 0; begin < entries.size();) {
+      size_t stripe = entries[begin].stripe;
+      size_t end = begin;
+      while (end < entries.size() && entries[end].stripe == stripe) end++;
+
+      size_t old_capacity;
+      size_t generation;
+      bool resize;
+      bool shrink;
+      {
+        auto lock = Acquire_(entries[begin].hash);
+
+        // the table was resized since grouping: regroup the elements not yet
+        // processed against the new lock array and start over with them. The
+        // array cannot be replaced while we hold one of its locks
+        size_t locks = locks_.load()->size();
+        if (locks != grouped_with) {
+          entries.erase(entries.begin(),
+                        entries.begin() + static_cast<ptrdiff_t>(begin));
+          GroupByStripe<Policy>(entries, locks);
+          grouped_with = locks;
+          begin = 0;
+          continue;
+        }
+
+        for (size_t i = begin; i < end; i++) {
+          PrefetchAhead(i, end, [&](size_t j) -> const Bucket& {
+            return Table_()[Policy::Index(entries[j].hash, Table_().size())];
+          });
+          const auto& entry = entries[i];
+          result[entry.index] =
+              op(Bucket_(entry.hash), elems[entry.index], entry.hash);
+        }
+        old_capacity = Table_().size();
+        generation = gate_.Generation();
+        resize = Policy_(old_capacity);
+        shrink = ShrinkPolicy_(old_capacity);
+      }  // release lock
+
+      if (resize) {
+        Resize_(generation, old_capacity, Policy::Grow(old_capacity));
+      } else if (shrink) {
+        Resize_(generation, old_capacity, Policy::Shrink(old_capacity));
+      }
+      begin = end;
+    }
+    return result;
+  }
+
+  /**
+   * Stops the world only while taking a view of each bucket, then copies the
+   * elements out while pinned, as HashSetStriped does.
+   */
+  std::vector<T> SnapshotElements_() final {
+    std::vector<std::span<const typename Bucket::Slot>> views;
+    AcquireOwnership_();
+    Quiesce_();
+    // pinned by the owner, so no resize can be waiting for this pin yet
+    auto guard = epoch_.Pin();
+    views.reserve(Table_().size());
+    for (const auto& bucket : Table_()) views.push_back(bucket.View());
+    size_t size = set_size_.Sum();
+    owner_.store(std::thread::id());
+
+    std::vector<T> elems;
+    elems.reserve(size);
+    for (auto view : views) {
+      for (const auto& slot : view) elems.push_back(Bucket::Slots::Elem(slot));
+    }
+    return elems;
+  }
+
+  /**
+   * Becomes the resizing thread, waiting for any other owner to finish.
+   */
+  void AcquireOwnership_() const {
+    std::thread::id none;
+    while (!owner_.compare_exchange_weak(none, std::this_thread::get_id())) {
+      none = std::thread::id();
+      std::this_thread::yield();
+    }
+  }
+
+  /**
+   * Waits until every lock in the current lock array has been released. Must
+   * only be called by the owner of the resize: once the mark is set, threads
+   * acquiring a lock immediately give it back, so this terminates.
+   */
+  void Quiesce_() const {
+    for (auto& lock : *locks_.load()) {
+      std::scoped_lock<Lock> wait(lock.value);
+    }
+  }
+
+  /**
+   * Rehashes the table from |old_capacity| to |new_capacity| buckets, as the
+   * policy decided at |generation|. Only the thread elected by |gate_| tries
+   * to stop the world, and it still backs off if another thread owns the
+   * table or the capacity changed meanwhile.
+   */
+  void Resize_(size_t generation, size_t old_capacity, size_t new_capacity) {
+    if (!gate_.TryBegin(generation)) return;
+
+    // become the resizing thread; if another thread already is, let it do the
+    // work instead
+    std::thread::id none;
+    if (!owner_.compare_exchange_strong(none, std::this_thread::get_id())) {
+      gate_.End();
+      return;
+    }
+
+    // another thread may have resized the table before we became the owner
+    if (Table_().size() == old_capacity) {
+      // wait for in-flight operations to drain
+      Quiesce_();
+
+      Rebuild_(new_capacity);
+    }
+
+    // release ownership, letting blocked threads proceed
+    owner_.store(std::thread::id());
+    gate_.End();
+  }
+
+  /**
+   * Rehashes every element into a new table of |buckets|, trimming every
+   * bucket to its elements if |fit| is set, and publishes the matching lock
+   * array. Must only be called by the owner of the resize, after quiescing.
+   */
+  void Rebuild_(size_t buckets, bool fit = false) {
+    stats_.BeginResize();
+
+    // 1) create a new empty table with the given number of buckets, backed by
+    //    a fresh arena
+    TableArena<Allocator> new_arena;
+    auto* new_table = new BucketArray<Bucket>(
+        MakeBuckets<Bucket>(buckets, new_arena.allocator()));
+    auto* old_table = &Table_();
+
+    // 2) copy elements from the old table to the new one, leaving the old one
+    //    intact for lookups. Growing by a whole factor sends each old bucket
+    //    to its own set of new ones, so threads waiting for the resize help
+    //    migrate ranges of old buckets
+    auto migrate = [&](size_t begin, size_t end) {
+      for (size_t b = begin; b < end; b++) {
+        for (const auto& slot : (*old_table)[b]) {
+          size_t hash = Bucket::Slots::Hash(slot, hasher_);
+          (*new_table)[Policy::Index(hash, new_table->size())].PushBack(slot);
+        }
+      }
+    };
+    if (kThreadSafeAllocator<Allocator> && buckets > old_table->size()) {
+      rehash_.Run(old_table->size(), migrate);
+    } else {
+      migrate(0, old_table->size());
+    }
+    if (fit) {
+      for (auto& bucket : *new_table) {
+        bucket.ShrinkToFit();
+      }
+    }
+
+    // 3) publish the new table and lock array, and retire the old array.
+    //    Then wait for lookups still reading the old table, and for every
+    //    node retired from it to be freed, before freeing it and dropping the
+    //    old arena with the storage of every old bucket
+    table_.store(new_table);
+    RetireLocks_(locks_.exchange(new LockArray(buckets)));
+    epoch_.Barrier();
+    delete old_table;
+    arena_ = std::move(new_arena);
+    gate_.Advance();
+    stats_.EndResize();
+  }
+
+  /**
+   * Retires a replaced lock array, first keeping its counts in the totals.
+   */
+  void RetireLocks_(LockArray* locks) {
+    if constexpr (kCollectStats) {
+      SetStats retired;
+      CollectLockStats(retired, *locks, [](const auto& lock) -> const Lock& {
+        return lock.value;
+      });
+      stats_.RecordRetiredLocks(retired.total_lock_acquisitions,
+                                retired.total_lock_wait_nanos);
+    }
+    epoch_.Retire(locks);
   }
 };
 
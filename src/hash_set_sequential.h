@@ -1,92 +1,131 @@
 #ifndef HASH_SET_SEQUENTIAL_H
 #define HASH_SET_SEQUENTIAL_H
 
-#include <algorithm>
 #include <cassert>
 #include <functional>
+#include <span>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "src/hash_set_base.h"
-
-template <typename T>
+#include "src/table/chained_table.h"
+#include "src/util/batch.h"
+#include "src/util/hash_policy.h"
+
+// |Table| selects the storage backend from src/table/: ChainedTable (the
+// default), FlatTable, or IncrementalTable to spread each resize over later
+// operations.
+template <typename T, typename Table = ChainedTable<T>>
 class HashSetSequential : public HashSetBase<T> {
  public:
-  explicit HashSetSequential(const size_t capacity)
-      : table_(capacity), set_size_(0) {
+  explicit HashSetSequential(const size_t capacity) : table_(capacity) {
     assert(capacity > 0);
   }
 
-  bool Add(T elem) final {
-    auto& bucket = Bucket_(elem);
+  bool Add(T&& elem) final { return Add_(std::move(elem)); }
 
-    // 3) return false on duplicate (loops over the elements in that bucket)
-    if (std::find(bucket.begin(), bucket.end(), elem) != bucket.end()) {
-      return false;
-    }
+  bool Add(const T& elem) final { return Add_(elem); }
 
-    // 4) insert and update size if not present
-    bucket.push_back(std::move(elem));
-    set_size_++;
+  bool Remove(const T& elem) final { return Remove_(elem); }
 
-    // 5) apply resizing policy if needed
-    if (Policy_()) {
-      Resize_();
-    }
-    return true;
+  [[nodiscard]] bool Contains(const T& elem) final {
+    return table_.Contains(elem);
   }
 
-  bool Remove(T elem) final {
-    // compute bucket index & find bucket
-    auto& bucket = Bucket_(elem);
+  // Lookups by a key that |Table|'s hasher accepts in place of a T.
+  template <TransparentKey<T, typename Table::hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove_(key);
+  }
 
-    // find element position (returning early if doesn't exist)
-    auto i = std::find(bucket.begin(), bucket.end(), elem);
-    if (i == bucket.end()) return false;
+  template <TransparentKey<T, typename Table::hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) {
+    return table_.Contains(key);
+  }
 
-    // remove element & decrement size
-    bucket.erase(i);
-    set_size_--;
-    return true;
+  // |fn| must not update the set.
+  void ForEach(const std::function<void(const T&)>& fn) final {
+    table_.ForEach([&](const T& elem) { fn(elem); });
   }
 
-  [[nodiscard]] bool Contains(T elem) final {
-    auto& bucket = Bucket_(elem);
+  [[nodiscard]] size_t Size() const final { return table_.Size(); }
 
-    // return if found or not
-    auto found = std::find(bucket.begin(), bucket.end(), elem) != bucket.end();
-    return found;
+  // Saves the table itself, for a |Table| whose image can be searched in
+  // place, as a FlatTable's can by MappedFlatTable.
+  bool SaveTable(const std::string& path, std::string& error) const
+    requires requires(const Table& table) { table.Save(path, error); }
+  {
+    return table_.Save(path, error);
   }
 
-  [[nodiscard]] size_t Size() const final { return set_size_; }
+  void Reserve(size_t n) final { table_.Reserve(n); }
 
- private:
-  std::vector<std::vector<T>> table_;
-  size_t set_size_;  // tracks the number of elements in the table
-  std::hash<T> hasher_;
-
-  /**
-   * Returns the bucket associated with the element.
-   */
-  std::vector<T>& Bucket_(T elem) {
-    return table_[hasher_(elem) % table_.size()];
+  void ShrinkToFit() final { table_.ShrinkToFit(); }
+
+  [[nodiscard]] SetStats Stats() const final {
+    SetStats stats;
+    table_.CollectStats(stats);
+    return stats;
+  }
+
+  std::vector<bool> AddAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Add(elems[i], hash);
+      if (table_.NeedsResize()) {
+        table_.Resize();
+      }
+    });
+    return result;
   }
 
-  bool Policy_() { return set_size_ / table_.size() > 4; }
+  std::vector<bool> RemoveAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Remove(elems[i], hash);
+    });
+    // apply shrinking policy once the batch is done; a large batch may call
+    // for several steps
+    while (table_.NeedsShrink()) {
+      table_.Shrink();
+    }
+    return result;
+  }
+
+  [[nodiscard]] std::vector<bool> ContainsAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+    ForEachPrefetched(table_, elems, [&](size_t i, size_t hash) {
+      result[i] = table_.Contains(elems[i], hash);
+    });
+    return result;
+  }
 
-  void Resize_() {
-    // 1) create a new empty table with double the number of buckets
-    std::vector<std::vector<T>> new_table(table_.size() * 2);
+ private:
+  Table table_;
 
-    // 2) move elements from the old table to the new one
-    for (auto& bucket : table_) {
-      for (auto& elem : bucket) {
-        size_t i = hasher_(elem) % new_table.size();
-        new_table[i].push_back(std::move(elem));
-      }
+  template <typename U>
+  bool Add_(U&& elem) {
+    // return false on duplicate, otherwise insert
+    if (!table_.Add(std::forward<U>(elem))) return false;
+
+    // apply resizing policy if needed
+    if (table_.NeedsResize()) {
+      table_.Resize();
     }
+    return true;
+  }
 
-    // 3) replace old table with new one
-    table_ = std::move(new_table);
+  template <typename Key>
+  bool Remove_(const Key& key) {
+    // return false if absent, otherwise remove
+    if (!table_.Remove(key)) return false;
+
+    // apply shrinking policy if needed
+    if (table_.NeedsShrink()) {
+      table_.Shrink();
+    }
+    return true;
   }
 };
 
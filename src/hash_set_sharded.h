@@ -0,0 +1,270 @@
+#ifndef HASH_SET_SHARDED_H
+#define HASH_SET_SHARDED_H
+
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "src/hash_set_base.h"
+#include "src/util/hash_policy.h"
+#include "src/util/numa.h"
+#include "src/util/set_stats.h"
+
+// A front-end that splits the set into shards, each an independent |Inner|
+// (any of the sets here), and routes every element to one of them by the high
+// bits of its hash under |Hasher|, mixed. Each shard has its own table, locks
+// and counters, so no cache line is shared between shards.
+//
+// The shards are spread evenly over the nodes of a NumaTopology, and each
+// node's shards are constructed, reserved and shrunk on a thread bound to
+// that node, so that under Linux's first-touch policy their memory is
+// allocated there. By default that thread is pinned to the node's CPUs; a
+// NodeBinder replaces this, for instance with libnuma's numa_run_on_node()
+// and numa_set_preferred(). The shards grow on whichever thread adds to them,
+// though, so traffic stays on a socket only where callers route work by key:
+// ShardOf() and NodeOf() give the node that owns an element, and
+// BindThisThread() binds a worker to it as the set binds its own threads.
+// With a single node there is nothing to place, and everything runs inline.
+//
+// Operations on one element touch only its shard and are as consistent as
+// |Inner|'s. Size(), ForEach() and Snapshot() visit the shards in turn, so
+// they are exact, or point-in-time, per shard only.
+template <typename Inner,
+          typename Hasher = std::hash<typename Inner::value_type>>
+class HashSetSharded : public HashSetBase<typename Inner::value_type> {
+  using T = typename Inner::value_type;
+
+ public:
+  // Binds the calling thread to |topology.nodes[node]| before it touches that
+  // node's shards.
+  using NodeBinder = std::function<void(size_t node)>;
+
+  // One shard on each node of the machine.
+  explicit HashSetSharded(const size_t capacity)
+      : HashSetSharded(capacity, NumaTopology::Detect()) {}
+
+  // |shards_per_node| shards on each node of |topology|, sharing |capacity|
+  // between them; |bind| replaces pinning to the node's CPUs if given.
+  HashSetSharded(const size_t capacity, NumaTopology topology,
+                 const size_t shards_per_node = 1, NodeBinder bind = {})
+      : topology_(std::move(topology)),
+        shards_per_node_(shards_per_node),
+        bind_(std::move(bind)),
+        shards_(topology_.nodes.size() * shards_per_node) {
+    assert(capacity > 0 && shards_per_node > 0);
+    size_t per_shard = (capacity + shards_.size() - 1) / shards_.size();
+    OnNodes_(
+        [&](size_t s) { shards_[s] = std::make_unique<Inner>(per_shard); });
+  }
+
+  HashSetSharded(const HashSetSharded&) = delete;
+  HashSetSharded& operator=(const HashSetSharded&) = delete;
+
+  bool Add(T&& elem) final {
+    Inner& shard = Owner_(elem);
+    return shard.Add(std::move(elem));
+  }
+
+  bool Add(const T& elem) final { return Owner_(elem).Add(elem); }
+
+  bool Remove(const T& elem) final { return Owner_(elem).Remove(elem); }
+
+  [[nodiscard]] bool Contains(const T& elem) final {
+    return Owner_(elem).Contains(elem);
+  }
+
+  // Lookups by a key that |Hasher|, and |Inner|'s hasher, accept in place of
+  // a T.
+  template <TransparentKey<T, Hasher> Key>
+  bool Remove(const Key& key) {
+    return Owner_(key).Remove(key);
+  }
+
+  template <TransparentKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) {
+    return Owner_(key).Contains(key);
+  }
+
+  // Visits the shards one after another, with |Inner|'s consistency within
+  // each.
+  void ForEach(const std::function<void(const T&)>& fn) final {
+    for (auto& shard : shards_) shard->ForEach(fn);
+  }
+
+  [[nodiscard]] size_t Size() const final {
+    size_t size = 0;
+    for (const auto& shard : shards_) size += shard->Size();
+    return size;
+  }
+
+  [[nodiscard]] size_t ApproxSize() const final {
+    size_t size = 0;
+    for (const auto& shard : shards_) size += shard->ApproxSize();
+    return size;
+  }
+
+  // Reserves an even share of |n| in every shard, on its node.
+  void Reserve(size_t n) final {
+    size_t per_shard = (n + shards_.size() - 1) / shards_.size();
+    OnNodes_([&](size_t s) { shards_[s]->Reserve(per_shard); });
+  }
+
+  void ShrinkToFit() final {
+    OnNodes_([&](size_t s) { shards_[s]->ShrinkToFit(); });
+  }
+
+  // The shards' statistics summed, with their locks listed shard by shard.
+  [[nodiscard]] SetStats Stats() const final {
+    SetStats stats;
+    for (const auto& shard : shards_) stats += shard->Stats();
+    return stats;
+  }
+
+  // The batch operations split the batch by shard and pass each shard its
+  // part as one batch.
+  std::vector<bool> AddAll(std::span<const T> elems) final {
+    return Batch_(elems, [](Inner& shard, std::span<const T> part) {
+      return shard.AddAll(part);
+    });
+  }
+
+  std::vector<bool> RemoveAll(std::span<const T> elems) final {
+    return Batch_(elems, [](Inner& shard, std::span<const T> part) {
+      return shard.RemoveAll(part);
+    });
+  }
+
+  [[nodiscard]] std::vector<bool> ContainsAll(std::span<const T> elems) final {
+    return Batch_(elems, [](Inner& shard, std::span<const T> part) {
+      return shard.ContainsAll(part);
+    });
+  }
+
+  // Returns the shard that |elem| belongs to.
+  [[nodiscard]] size_t ShardOf(const T& elem) const {
+    return ShardOfHash_(hasher_(elem));
+  }
+
+  // Returns the index in Topology().nodes of the node |shard| lives on.
+  [[nodiscard]] size_t NodeOf(size_t shard) const {
+    return shard / shards_per_node_;
+  }
+
+  [[nodiscard]] size_t Shards() const { return shards_.size(); }
+
+  [[nodiscard]] const NumaTopology& Topology() const { return topology_; }
+
+  // Binds the calling thread to |node| as the set binds its own threads, for
+  // workers that serve that node's shards.
+  void BindThisThread(size_t node) const {
+    if (bind_) {
+      bind_(node);
+    } else {
+      (void)topology_.PinThisThreadToNode(node);
+    }
+  }
+
+ private:
+  NumaTopology topology_;
+  size_t shards_per_node_;
+  NodeBinder bind_;  // empty to pin to the node's CPUs
+  // Each shard is a separate allocation, made on its node. The array itself
+  // is only read after construction, so its cache lines are shared cleanly.
+  std::vector<std::unique_ptr<Inner>> shards_;
+  Hasher hasher_;
+
+  /**
+   * Returns the shard for |hash|, taken from the high half of its mixed bits
+   * by multiplying rather than dividing, so any shard count works and the
+   * shards stay independent of the low bits that index each shard's buckets.
+   */
+  size_t ShardOfHash_(size_t hash) const {
+    uint64_t high = Mix64(static_cast<uint64_t>(hash)) >> 32;
+    return static_cast<size_t>((high * shards_.size()) >> 32);
+  }
+
+  template <typename Key>
+  Inner& Owner_(const Key& key) {
+    return *shards_[ShardOfHash_(hasher_(key))];
+  }
+
+  /**
+   * Calls |fn(s)| for the index |s| of every shard, each node's shards on a
+   * thread bound to that node, and waits for all of them. Runs inline when
+   * there is only one node and no binder, since placement is then moot.
+   */
+  template <typename Fn>
+  void OnNodes_(Fn fn) {
+    auto run = [&](size_t node) {
+      for (size_t s = node * shards_per_node_;
+           s < (node + 1) * shards_per_node_; s++) {
+        fn(s);
+      }
+    };
+    if (topology_.nodes.size() == 1 && !bind_) {
+      run(0);
+      return;
+    }
+    std::vector<std::thread> threads;
+    for (size_t node = 0; node < topology_.nodes.size(); node++) {
+      threads.emplace_back([this, &run, node] {
+        BindThisThread(node);
+        run(node);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Applies |op(shard, part)| to the elements of each shard as one batch and
+   * gathers the results in batch order. Equal elements share a shard and keep
+   * their order within its part.
+   */
+  template <typename Op>
+  std::vector<bool> Batch_(std::span<const T> elems, Op op) {
+    if (shards_.size() == 1) return op(*shards_[0], elems);
+
+    std::vector<std::vector<size_t>> indices(shards_.size());
+    for (size_t i = 0; i < elems.size(); i++) {
+      indices[ShardOf(elems[i])].push_back(i);
+    }
+    std::vector<bool> result(elems.size());
+    std::vector<T> part;
+    for (size_t s = 0; s < shards_.size(); s++) {
+      if (indices[s].empty()) continue;
+      part.clear();
+      for (size_t i : indices[s]) part.push_back(elems[i]);
+      auto part_result = op(*shards_[s], std::span<const T>(part));
+      for (size_t j = 0; j < indices[s].size(); j++) {
+        result[indices[s][j]] = part_result[j];
+      }
+    }
+    return result;
+  }
+
+  std::vector<T> SnapshotElements_() final {
+    if constexpr (std::totally_ordered<T>) {
+      // each shard's snapshot is of one point in time
+      std::vector<T> elems;
+      elems.reserve(ApproxSize());
+      for (auto& shard : shards_) {
+        auto part = shard->Snapshot();
+        elems.insert(elems.end(), part.begin(), part.end());
+      }
+      return elems;
+    } else {
+      return HashSetBase<T>::SnapshotElements_();
+    }
+  }
+};
+
+#endif  // HASH_SET_SHARDED_H
@@ -2,32 +2,464 @@
 #define HASH_SET_STRIPED_H
 
 #include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
 
 #include "src/hash_set_base.h"
+#include "src/reclaim/epoch.h"
+#include "src/util/arena.h"
+#include "src/util/batch.h"
+#include "src/util/cache_line.h"
+#include "src/util/cooperative_rehash.h"
+#include "src/util/hash_policy.h"
+#include "src/util/prefetch.h"
+#include "src/util/rcu_bucket.h"
+#include "src/util/resize_gate.h"
+#include "src/util/set_stats.h"
+#include "src/util/sharded_counter.h"
 
-template <typename T>
+// |Hasher| and |Policy| are as for ChainedTable. |Allocator| provides the
+// bucket storage. Buckets under different stripes are updated concurrently, so
+// an arena must be thread-safe, such as ArenaAllocator<T, ShardedArena>.
+// |kPadBuckets| gives each bucket a cache line of its own (see RcuBucket); the
+// stripe locks always have one each. |Mutex| is the type of the stripe locks,
+// std::mutex or one of the spinning locks in src/util/locks.h.
+//
+// Contains and ContainsAll take no locks: buckets are RcuBuckets, and the
+// table is published through an atomic pointer, so lookups only pin an
+// EpochDomain and write nothing shared. Whatever writers replace is retired
+// to that domain and freed once no lookup can still be reading it.
+template <typename T, typename Hasher = std::hash<T>,
+          typename Policy = DefaultBucketPolicy,
+          typename Allocator = std::allocator<T>, bool kPadBuckets = false,
+          typename Mutex = std::mutex>
 class HashSetStriped : public HashSetBase<T> {
  public:
-  explicit HashSetStriped(size_t /*initial_capacity*/) {}
-
-  bool Add(T /*elem*/) final {
-    assert(false && "Not implemented yet");
-    return false;
+  explicit HashSetStriped(const size_t capacity)
+      : table_(new BucketArray<Bucket>(MakeBuckets<Bucket>(
+            Policy::Buckets(capacity), arena_.allocator()))),
+        locks_(Table_().size()) {
+    assert(capacity > 0);
   }
 
-  bool Remove(T /*elem*/) final {
-    assert(false && "Not implemented yet");
-    return false;
+  HashSetStriped(const HashSetStriped&) = delete;
+  HashSetStriped& operator=(const HashSetStriped&) = delete;
+
+  ~HashSetStriped() override { delete table_.load(); }
+
+  bool Add(T&& elem) final { return Add_(std::move(elem)); }
+
+  bool Add(const T& elem) final { return Add_(elem); }
+
+  bool Remove(const T& elem) final { return Remove_(elem); }
+
+  [[nodiscard]] bool Contains(const T& elem) final { return Contains_(elem); }
+
+  // Lookups by a key that |Hasher| accepts in place of a T.
+  template <TransparentKey<T, Hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove_(key);
   }
 
-  [[nodiscard]] bool Contains(T /*elem*/) final {
-    assert(false && "Not implemented yet");
-    return false;
+  template <TransparentKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) {
+    return Contains_(key);
   }
 
   [[nodiscard]] size_t Size() const final {
-    assert(false && "Not implemented yet");
-    return 0u;
+    // every update happens under a stripe lock, so holding all of them makes
+    // the sum of the shards exact
+    auto held = LockAll_();
+    return set_size_.Sum();
+  }
+
+  [[nodiscard]] size_t ApproxSize() const final { return set_size_.Approx(); }
+
+  void Reserve(size_t n) final {
+    // acquire every stripe
+    auto held = LockAll_();
+
+    size_t buckets = Policy::Reserved(n, Table_().size());
+    if (buckets != Table_().size()) Rebuild_(buckets);
+  }
+
+  void ShrinkToFit() final {
+    // acquire every stripe, which also makes the size exact
+    auto held = LockAll_();
+
+    // always rebuild, so that an arena holding freed buckets is released too
+    Rebuild_(Policy::Fitted(set_size_.Sum(), Table_().size(), locks_.size()),
+             /*fit=*/true);
+  }
+
+  std::vector<bool> AddAll(std::span<const T> elems) final {
+    return Batch_(elems, [this](Bucket& bucket, const T& elem,
+                                  size_t hash) {
+      if (!bucket.Add(elem, hash, epoch_)) return false;
+      set_size_.Increment();
+      return true;
+    });
+  }
+
+  std::vector<bool> RemoveAll(std::span<const T> elems) final {
+    return Batch_(elems, [this](Bucket& bucket, const T& elem,
+                                  size_t hash) {
+      if (!bucket.Remove(elem, hash, epoch_)) return false;
+      set_size_.Decrement();
+      return true;
+    });
+  }
+
+  // Like Contains, takes no locks; the whole batch runs under one pin against
+  // one version of the table.
+  [[nodiscard]] std::vector<bool> ContainsAll(std::span<const T> elems) final {
+    std::vector<bool> result(elems.size());
+    std::vector<size_t> hashes(elems.size());
+    for (size_t i = 0; i < elems.size(); i++) {
+      hashes[i] = hasher_(elems[i]);
+    }
+
+    auto guard = epoch_.Pin();
+    const auto& table = *table_.load();
+    for (size_t i = 0; i < elems.size(); i++) {
+      PrefetchAhead(i, elems.size(), [&](size_t j) -> const Bucket& {
+        return table[Policy::Index(hashes[j], table.size())];
+      });
+      const auto& bucket = table[Policy::Index(hashes[i], table.size())];
+      stats_.RecordSearch(bucket);
+      result[i] = bucket.Contains(elems[i], hashes[i]);
+    }
+    return result;
+  }
+
+  // Takes no locks. Walks the set one stripe at a time, each under its own
+  // pin against the then current table, and calls |fn| on that stripe's
+  // elements after unpinning, so |fn| may update the set. An element's stripe
+  // depends only on its hash, so a resize between stripes neither repeats nor
+  // skips any element that stays in the set throughout.
+  void ForEach(const std::function<void(const T&)>& fn) final {
+    std::vector<T> batch;
+    for (size_t stripe = 0; stripe < locks_.size(); stripe++) {
+      {
+        auto guard = epoch_.Pin();
+        const auto& table = *table_.load();
+        for (size_t b = stripe; b < table.size(); b += locks_.size()) {
+          table[b].ReaderForEach([&](const typename Bucket::Slot& slot) {
+            batch.push_back(Bucket::Slots::Elem(slot));
+          });
+        }
+      }  // unpin
+      for (const T& elem : batch) fn(elem);
+      batch.clear();
+    }
+  }
+
+  // Reads the counters without taking the stripes, so as not to disturb the
+  // set.
+  [[nodiscard]] SetStats Stats() const final {
+    SetStats stats;
+    stats_.Collect(stats);
+    stats.helped_buckets = rehash_.HelpedBuckets();
+    CollectLockStats(stats, locks_,
+                     [](const auto& padded) -> const Lock& {
+                       return padded.value;
+                     });
+    return stats;
+  }
+
+ private:
+  using Bucket = RcuBucket<T, Allocator, kPadBuckets>;
+
+  // counts acquisitions and waits when built with HASH_SET_STATS
+  using Lock = StatsMutex<Mutex>;
+
+  // declared before |table_|, which it must outlive
+  [[no_unique_address]] TableArena<Allocator> arena_;
+  // The current table, replaced on every rebuild. Writers read it under a
+  // stripe lock; lookups read it while pinned in |epoch_|.
+  std::atomic<BucketArray<Bucket>*> table_;
+  // One lock per stripe, fixed at construction. Bucket i is guarded by lock
+  // Policy::Index(i, locks_.size()); since the table only ever grows by a
+  // whole factor from its initial capacity, every bucket maps to exactly one
+  // stripe.
+  mutable std::vector<CacheLinePadded<Lock>> locks_;
+  // tracks the number of elements in the table, sharded to avoid contention
+  ShardedCounter set_size_;
+  // splits the rehash of a growing table among the threads waiting on it
+  CooperativeRehash rehash_;
+  // elects the thread that acts on a resize the policy calls for
+  ResizeGate gate_;
+  // frees what writers replace once no lookup can still be reading it
+  EpochDomain epoch_;
+  Hasher hasher_;
+  // lookups record their searches, hence mutable
+  [[no_unique_address]] mutable StatsRecorder stats_;
+
+  /**
+   * Returns the current table. The caller must hold a stripe lock.
+   */
+  BucketArray<Bucket>& Table_() const {
+    return *table_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Locks stripe |stripe|, helping instead of blocking while a rehash, whose
+   * thread holds every stripe, is in progress.
+   */
+  std::unique_lock<Lock> LockStripe_(size_t stripe) {
+    std::unique_lock<Lock> lock(locks_[stripe].value, std::defer_lock);
+    rehash_.Acquire(lock);
+    return lock;
+  }
+
+  /**
+   * Locks the stripe associated with the hash, as LockStripe_().
+   */
+  std::unique_lock<Lock> LockStripeOf_(size_t hash) {
+    return LockStripe_(Policy::Index(hash, locks_.size()));
+  }
+
+  /**
+   * Returns the bucket associated with the hash, recording its search. The
+   * caller must hold the corresponding stripe lock.
+   */
+  Bucket& Bucket_(size_t hash) {
+    auto& bucket = Table_()[Policy::Index(hash, Table_().size())];
+    stats_.RecordSearch(bucket);
+    return bucket;
+  }
+
+  template <typename U>
+  bool Add_(U&& elem) {
+    size_t hash = hasher_(elem);
+    size_t old_capacity;
+    size_t generation;
+    bool resize;
+    {
+      // scope-lock the stripe guarding this element
+      auto lock = LockStripeOf_(hash);
+
+      // 3) return false on duplicate, otherwise insert and update size
+      if (!Bucket_(hash).Add(std::forward<U>(elem), hash, epoch_)) return false;
+      set_size_.Increment();
+
+      // the table cannot be resized while we hold a stripe, so this snapshot
+      // of the capacity and generation is consistent with the policy check
+      old_capacity = Table_().size();
+      generation = gate_.Generation();
+      resize = Policy_(old_capacity);
+    }  // release lock
+
+    // 5) apply resizing policy if needed
+    if (resize) {
+      Resize_(generation, old_capacity, Policy::Grow(old_capacity));
+    }
+    return true;
+  }
+
+  template <typename Key>
+  bool Remove_(const Key& key) {
+    size_t hash = hasher_(key);
+    size_t old_capacity;
+    size_t generation;
+    bool shrink;
+    {
+      // scope-lock the stripe guarding this element
+      auto lock = LockStripeOf_(hash);
+
+      // remove element (returning early if doesn't exist) & decrement size
+      if (!Bucket_(hash).Remove(key, hash, epoch_)) return false;
+      set_size_.Decrement();
+
+      old_capacity = Table_().size();
+      generation = gate_.Generation();
+      shrink = ShrinkPolicy_(old_capacity);
+    }  // release lock
+
+    // apply shrinking policy if needed
+    if (shrink) {
+      Resize_(generation, old_capacity, Policy::Shrink(old_capacity));
+    }
+    return true;
+  }
+
+  template <typename Key>
+  bool Contains_(const Key& key) {
+    size_t hash = hasher_(key);
+
+    // no lock: the table and bucket read here stay allocated while pinned
+    auto guard = epoch_.Pin();
+    const auto& table = *table_.load();
+    const auto& bucket = table[Policy::Index(hash, table.size())];
+    stats_.RecordSearch(bucket);
+
+    // return if found or not
+    return bucket.Contains(key, hash);
+  }
+
+  /**
+   * Holds every stripe only while taking a view of each bucket, then copies
+   * the elements out while pinned, which keeps the viewed nodes alive however
+   * writers replace them meanwhile. A resize that starts during the copy waits
+   * for it in Barrier().
+   */
+  std::vector<T> SnapshotElements_() final {
+    std::vector<std::span<const typename Bucket::Slot>> views;
+    // lock before pinning: Rebuild_() waits for pins while holding the stripes
+    auto held = LockAll_();
+    auto guard = epoch_.Pin();
+    views.reserve(Table_().size());
+    for (const auto& bucket : Table_()) views.push_back(bucket.View());
+    size_t size = set_size_.Sum();
+    held.clear();  // release all stripes
+
+    std::vector<T> elems;
+    elems.reserve(size);
+    for (auto view : views) {
+      for (const auto& slot : view) elems.push_back(Bucket::Slots::Elem(slot));
+    }
+    return elems;
+  }
+
+  bool Policy_(size_t capacity) {
+    return Policy::NeedsResize(set_size_.Approx(), capacity);
+  }
+
+  // the table never shrinks below one bucket per stripe
+  bool ShrinkPolicy_(size_t capacity) {
+    return Policy::NeedsShrink(set_size_.Approx(), capacity, locks_.size());
+  }
+
+  /**
+   * Acquires every stripe, always in the same order so that concurrent callers
+   * cannot deadlock, and returns the held locks.
+   */
+  std::vector<std::unique_lock<Lock>> LockAll_() const {
+    std::vector<std::unique_lock<Lock>> held;
+    held.reserve(locks_.size());
+    for (auto& lock : locks_) {
+      held.emplace_back(lock.value);
+    }
+    return held;
+  }
+
+  /**
+   * Applies |op(bucket, elem, hash)| to every element of the batch, taking each
+   * stripe's lock once for all of the batch's elements in that stripe. The
+   * stripe of an element depends only on its hash, so the grouping stays valid
+   * across resizes between stripes.
+   */
+  template <typename Op>
+  std::vector<bool> Batch_(std::span<const T> elems, Op op) {
+    std::vector<bool> result(elems.size());
+    auto entries = GroupByStripe<Policy>(elems, hasher_, locks_.size());
+
+    for (size_t begin = 0; begin < entries.size();) {
+      size_t stripe = entries[begin].stripe;
+      size_t end = begin;
+      while (end < entries.size() && entries[end].stripe == stripe) end++;
+
+      size_t old_capacity;
+      size_t generation;
+      bool resize;
+      bool shrink;
+      {
+        auto lock = LockStripe_(stripe);
+        for (size_t i = begin; i < end; i++) {
+          PrefetchAhead(i, end, [&](size_t j) -> const Bucket& {
+            return Table_()[Policy::Index(entries[j].hash, Table_().size())];
+          });
+          const auto& entry = entries[i];
+          result[entry.index] =
+              op(Bucket_(entry.hash), elems[entry.index], entry.hash);
+        }
+        old_capacity = Table_().size();
+        generation = gate_.Generation();
+        resize = Policy_(old_capacity);
+        shrink = ShrinkPolicy_(old_capacity);
+      }  // release lock
+
+      if (resize) {
+        Resize_(generation, old_capacity, Policy::Grow(old_capacity));
+      } else if (shrink) {
+        Resize_(generation, old_capacity, Policy::Shrink(old_capacity));
+      }
+      begin = end;
+    }
+    return result;
+  }
+
+  /**
+   * Rehashes the table from |old_capacity| to |new_capacity| buckets, as the
+   * policy decided at |generation|. Only the thread elected by |gate_| takes
+   * the stripes, and it still backs off if the capacity changed meanwhile.
+   */
+  void Resize_(size_t generation, size_t old_capacity, size_t new_capacity) {
+    if (!gate_.TryBegin(generation)) return;
+
+    {
+      // acquire every stripe
+      auto held = LockAll_();
+
+      // a Reserve() or ShrinkToFit() may have resized the table meanwhile
+      if (Table_().size() == old_capacity) {
+        Rebuild_(new_capacity);
+      }
+    }  // release all stripes
+
+    gate_.End();
+  }
+
+  /**
+   * Rehashes every element into a new table of |buckets|, trimming every
+   * bucket to its elements if |fit| is set. The caller must hold every
+   * stripe.
+   */
+  void Rebuild_(size_t buckets, bool fit = false) {
+    stats_.BeginResize();
+
+    // 1) create a new empty table with the given number of buckets, backed by
+    //    a fresh arena
+    TableArena<Allocator> new_arena;
+    auto* new_table = new BucketArray<Bucket>(
+        MakeBuckets<Bucket>(buckets, new_arena.allocator()));
+    auto* old_table = &Table_();
+
+    // 2) copy elements from the old table to the new one, leaving the old one
+    //    intact for lookups. Growing by a whole factor sends each old bucket
+    //    to its own set of new ones, so threads arriving at the stripes help
+    //    migrate ranges of old buckets
+    auto migrate = [&](size_t begin, size_t end) {
+      for (size_t b = begin; b < end; b++) {
+        for (const auto& slot : (*old_table)[b]) {
+          size_t hash = Bucket::Slots::Hash(slot, hasher_);
+          (*new_table)[Policy::Index(hash, new_table->size())].PushBack(slot);
+        }
+      }
+    };
+    if (kThreadSafeAllocator<Allocator> && buckets > old_table->size()) {
+      rehash_.Run(old_table->size(), migrate);
+    } else {
+      migrate(0, old_table->size());
+    }
+    if (fit) {
+      for (auto& bucket : *new_table) {
+        bucket.ShrinkToFit();
+      }
+    }
+
+    // 3) publish the new table. Then wait for lookups still reading the old
+    //    one, and for every node retired from it to be freed, before freeing
+    //    it and dropping the old arena with the storage of every old bucket
+    table_.store(new_table);
+    epoch_.Barrier();
+    delete old_table;
+    arena_ = std::move(new_arena);
+    gate_.Advance();
+    stats_.EndResize();
   }
 };
 
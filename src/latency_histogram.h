@@ -0,0 +1,92 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace benchmark {
+
+// A histogram of latencies in nanoseconds with HDR-style log-linear buckets:
+// each power of two is split into kSubBuckets equal buckets, so values below
+// kSubBuckets are exact and larger ones are kept to within 1/kSubBuckets of
+// their size, over the whole range of uint64_t in a fixed 15 KB.
+class LatencyHistogram {
+ public:
+  LatencyHistogram() : counts_(kBuckets) {}
+
+  void Record(uint64_t nanos) {
+    counts_[Index_(nanos)]++;
+    count_++;
+    max_ = std::max(max_, nanos);
+  }
+
+  LatencyHistogram& operator+=(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kBuckets; i++) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    max_ = std::max(max_, other.max_);
+    return *this;
+  }
+
+  [[nodiscard]] uint64_t Count() const { return count_; }
+
+  [[nodiscard]] uint64_t Max() const { return max_; }
+
+  // Returns a value at or below which |fraction| of the recorded values lie:
+  // the highest value of the bucket holding that rank, so it overestimates
+  // by less than the bucket's width. Returns 0 if nothing was recorded.
+  [[nodiscard]] uint64_t Percentile(double fraction) const {
+    if (count_ == 0) return 0;
+    auto rank = static_cast<uint64_t>(
+        std::ceil(fraction * static_cast<double>(count_)));
+    rank = std::clamp<uint64_t>(rank, 1, count_);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+      seen += counts_[i];
+      if (seen >= rank) return std::min(Highest_(i), max_);
+    }
+    return max_;
+  }
+
+ private:
+  static constexpr int kSubBits = 5;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBits;
+  // one group of sub-buckets for the exact values, and one per power of two
+  // from kSubBuckets upwards
+  static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  uint64_t max_ = 0;
+
+  /**
+   * Returns the bucket of |value|.
+   */
+  static size_t Index_(uint64_t value) {
+    if (value < kSubBuckets) return static_cast<size_t>(value);
+    // value >> shift lies in [kSubBuckets, 2 * kSubBuckets)
+    auto shift = static_cast<size_t>(std::bit_width(value)) - kSubBits - 1;
+    return (shift + 1) * kSubBuckets +
+           static_cast<size_t>(value >> shift) - kSubBuckets;
+  }
+
+  /**
+   * Returns the highest value that falls in bucket |index|.
+   */
+  static uint64_t Highest_(size_t index) {
+    if (index < kSubBuckets) return index;
+    size_t shift = index / kSubBuckets - 1;
+    uint64_t lowest = uint64_t{kSubBuckets + index % kSubBuckets} << shift;
+    return lowest + ((uint64_t{1} << shift) - 1);
+  }
+};
+
+}  // namespace benchmark
+
+#endif  // LATENCY_HISTOGRAM_H
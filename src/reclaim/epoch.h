@@ -0,0 +1,170 @@
+#ifndef RECLAIM_EPOCH_H
+#define RECLAIM_EPOCH_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "src/util/cache_line.h"
+#include "src/util/thread_index.h"
+
+// Epoch-based memory reclamation (Fraser). Readers pin the current epoch for
+// the duration of an operation; memory that writers unlink is retired with
+// the epoch at which it was unlinked, and freed once the global epoch has
+// advanced twice past that, when no reader can still hold it. The epoch only
+// advances when no pinned reader lags behind it, so a reader never waits and
+// a writer never waits for readers, except in Barrier().
+//
+// Threads register through ThreadIndex(), which gives every live thread its
+// own slot up to kSlots threads. A slot counts the readers pinned in each of
+// the three epochs that can be live at once, so the rare threads sharing a
+// slot remain correct. Each slot also keeps its threads' retire list, which
+// is scanned for memory to free every kBatch retirements.
+//
+// The stores that unlink memory, and the loads by which readers reach it,
+// must be seq_cst: then a reader that pins an epoch after memory was retired
+// also sees it unlinked. (On x86 and AArch64 such loads cost no more than
+// acquire loads.)
+class EpochDomain {
+ public:
+  // Unpins the reader when destroyed.
+  class Guard {
+   public:
+    explicit Guard(std::atomic<size_t>* readers) : readers_(readers) {}
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+
+    ~Guard() { readers_->fetch_sub(1, std::memory_order_release); }
+
+   private:
+    std::atomic<size_t>* readers_;
+  };
+
+  EpochDomain() = default;
+  EpochDomain(const EpochDomain&) = delete;
+  EpochDomain& operator=(const EpochDomain&) = delete;
+
+  // No reader may still be pinned; frees everything retired.
+  ~EpochDomain() {
+    for (auto& list : lists_) {
+      for (const auto& retired : list.value.retired) {
+        retired.deleter(retired.ptr);
+      }
+    }
+  }
+
+  // Pins the current epoch until the guard is destroyed. Pins may nest.
+  [[nodiscard]] Guard Pin() {
+    auto& readers = readers_[ThreadIndex() % kSlots].value;
+    while (true) {
+      size_t epoch = epoch_.load();
+      readers[epoch % 3].fetch_add(1);
+      // the epoch may have advanced past the one we counted ourselves in
+      // before we did; count ourselves in the new one instead
+      if (epoch_.load() == epoch) return Guard(&readers[epoch % 3]);
+      readers[epoch % 3].fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  // Frees |ptr| with |deleter| once no reader pinned now can still hold it.
+  // |ptr| must already be unreachable for new readers.
+  void Retire(void* ptr, void (*deleter)(void*)) {
+    Retired retired{ptr, deleter, epoch_.load()};
+    auto& list = lists_[ThreadIndex() % kSlots].value;
+    std::vector<Retired> expired;
+    {
+      std::scoped_lock<std::mutex> lock(list.mutex);
+      list.retired.push_back(retired);
+      if (list.retired.size() % kBatch != 0) return;
+
+      TryAdvance_();
+      expired = Expired_(list.retired);
+    }  // release lock
+
+    // free outside the lock, since a deleter may be slow
+    for (const auto& e : expired) {
+      e.deleter(e.ptr);
+    }
+  }
+
+  template <typename T>
+  void Retire(T* ptr) {
+    Retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+  }
+
+  // Waits until the epoch has advanced far enough to free everything retired
+  // before the call, then frees it. Waits for pinned readers, so must not be
+  // called while pinned, or while holding anything a pinned reader waits for.
+  void Barrier() {
+    size_t target = epoch_.load() + 2;
+    while (epoch_.load() < target) {
+      if (!TryAdvance_()) std::this_thread::yield();
+    }
+
+    for (auto& list : lists_) {
+      std::vector<Retired> expired;
+      {
+        std::scoped_lock<std::mutex> lock(list.value.mutex);
+        expired = Expired_(list.value.retired);
+      }
+      for (const auto& e : expired) {
+        e.deleter(e.ptr);
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kSlots = 64;
+  static constexpr size_t kBatch = 64;
+
+  struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+    size_t epoch;  // the global epoch when |ptr| was retired
+  };
+
+  struct RetireList {
+    std::mutex mutex;
+    std::vector<Retired> retired;
+  };
+
+  std::atomic<size_t> epoch_{0};
+  // per slot, the number of readers pinned in each epoch modulo 3
+  std::array<CacheLinePadded<std::array<std::atomic<size_t>, 3>>, kSlots>
+      readers_{};
+  // kept apart from |readers_| so that retiring does not disturb readers
+  std::array<CacheLinePadded<RetireList>, kSlots> lists_{};
+
+  /**
+   * Advances the epoch by one unless a reader is still pinned in the previous
+   * epoch. Returns true if the epoch advanced, here or in another thread.
+   */
+  bool TryAdvance_() {
+    size_t epoch = epoch_.load();
+    for (auto& readers : readers_) {
+      if (readers.value[(epoch + 2) % 3].load() != 0) return false;
+    }
+    // the epoch only ever advances, so failing means another thread did it
+    epoch_.compare_exchange_strong(epoch, epoch + 1);
+    return true;
+  }
+
+  /**
+   * Removes from |retired| and returns every entry that can now be freed.
+   */
+  std::vector<Retired> Expired_(std::vector<Retired>& retired) {
+    size_t epoch = epoch_.load();
+    auto live = std::stable_partition(
+        retired.begin(), retired.end(),
+        [epoch](const Retired& r) { return r.epoch + 2 > epoch; });
+    std::vector<Retired> expired(live, retired.end());
+    retired.erase(live, retired.end());
+    return expired;
+  }
+};
+
+#endif  // RECLAIM_EPOCH_H
@@ -0,0 +1,189 @@
+#include "src/report.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <ostream>
+
+namespace benchmark {
+
+namespace {
+
+// The throughput and latency of one type of operation over some scope.
+struct Line {
+  std::string scope;
+  std::string op;
+  size_t ops;
+  double seconds;
+  LatencyHistogram latency;
+
+  [[nodiscard]] uint64_t OpsPerSec() const {
+    return seconds > 0 ? static_cast<uint64_t>(static_cast<double>(ops) /
+                                               seconds)
+                       : 0;
+  }
+};
+
+/**
+ * Returns the aggregate lines, for all operations and then for each type,
+ * followed by one line for each thread.
+ */
+std::vector<Line> Lines(const RunReport& report) {
+  WorkloadResult total;
+  for (const auto& result : report.results) {
+    total += result;
+  }
+  auto all = [](const WorkloadResult& result) {
+    LatencyHistogram latency = result.read_latency;
+    latency += result.insert_latency;
+    latency += result.remove_latency;
+    return latency;
+  };
+
+  std::vector<Line> lines;
+  lines.push_back({"all", "all", total.Ops(), report.seconds, all(total)});
+  lines.push_back(
+      {"all", "contains", total.reads, report.seconds, total.read_latency});
+  lines.push_back(
+      {"all", "add", total.inserts, report.seconds, total.insert_latency});
+  lines.push_back(
+      {"all", "remove", total.removes, report.seconds, total.remove_latency});
+  for (size_t i = 0; i < report.results.size(); i++) {
+    const auto& result = report.results[i];
+    lines.push_back({"thread" + std::to_string(i), "all", result.Ops(),
+                     result.seconds, all(result)});
+  }
+  return lines;
+}
+
+/**
+ * Summarises the set's statistics, if it collected any.
+ */
+void WriteStats(std::ostream& out, const SetStats& stats) {
+  if (!kCollectStats) return;
+
+  auto millis = [](uint64_t nanos) { return static_cast<double>(nanos) / 1e6; };
+  out << "Set statistics:" << std::endl;
+  out << "  lock acquisitions: " << stats.total_lock_acquisitions
+      << ", waiting " << millis(stats.total_lock_wait_nanos) << " ms"
+      << std::endl;
+  if (!stats.lock_wait_nanos.empty()) {
+    auto hottest = std::max_element(stats.lock_wait_nanos.begin(),
+                                    stats.lock_wait_nanos.end());
+    auto i = static_cast<size_t>(hottest - stats.lock_wait_nanos.begin());
+    out << "  most contended of " << stats.lock_wait_nanos.size()
+        << " locks: #" << i << ", " << stats.lock_acquisitions[i]
+        << " acquisitions, waiting " << millis(*hottest) << " ms" << std::endl;
+  }
+  out << "  resizes: " << stats.resizes << ", taking "
+      << millis(stats.resize_nanos) << " ms, " << stats.helped_buckets
+      << " buckets migrated by waiting threads" << std::endl;
+  out << "  searched bucket sizes (0.." << SetStats::kBucketSizes - 1
+      << "+):";
+  for (uint64_t count : stats.bucket_sizes) {
+    out << ' ' << count;
+  }
+  out << std::endl;
+  out << "  largest searched bucket: " << stats.max_bucket_size << std::endl;
+}
+
+void WriteText(std::ostream& out, const RunReport& report,
+               const std::vector<Line>& lines) {
+  out << "Workload: " << report.workload << std::endl;
+  out << "Concurrent computation took:" << std::endl;
+  out << "  " << static_cast<uint64_t>(report.seconds * 1000) << " ms"
+      << std::endl;
+  out << "Throughput and sampled latency (ns):" << std::endl;
+  out << "  " << std::left << std::setw(10) << "scope" << std::setw(10)
+      << "op" << std::right << std::setw(12) << "ops" << std::setw(14)
+      << "ops/s" << std::setw(10) << "p50" << std::setw(10) << "p99"
+      << std::setw(10) << "p999" << std::setw(12) << "max" << std::endl;
+  for (const auto& line : lines) {
+    out << "  " << std::left << std::setw(10) << line.scope << std::setw(10)
+        << line.op << std::right << std::setw(12) << line.ops
+        << std::setw(14) << line.OpsPerSec() << std::setw(10)
+        << line.latency.Percentile(0.5) << std::setw(10)
+        << line.latency.Percentile(0.99) << std::setw(10)
+        << line.latency.Percentile(0.999) << std::setw(12)
+        << line.latency.Max() << std::endl;
+  }
+  WriteStats(out, report.stats);
+}
+
+void WriteJson(std::ostream& out, const RunReport& report,
+               const std::vector<Line>& lines) {
+  out << "{\"set\": ";
+  WriteQuoted(out, report.set, /*json=*/true);
+  out << ", \"threads\": " << report.threads << ", \"workload\": ";
+  WriteQuoted(out, report.workload, /*json=*/true);
+  out << ", \"seconds\": " << report.seconds << ", \"lines\": [";
+  for (size_t i = 0; i < lines.size(); i++) {
+    const auto& line = lines[i];
+    out << (i == 0 ? "" : ", ") << "{\"scope\": \"" << line.scope
+        << "\", \"op\": \"" << line.op << "\", \"ops\": " << line.ops
+        << ", \"seconds\": " << line.seconds
+        << ", \"ops_per_sec\": " << line.OpsPerSec()
+        << ", \"samples\": " << line.latency.Count()
+        << ", \"p50_ns\": " << line.latency.Percentile(0.5)
+        << ", \"p99_ns\": " << line.latency.Percentile(0.99)
+        << ", \"p999_ns\": " << line.latency.Percentile(0.999)
+        << ", \"max_ns\": " << line.latency.Max() << "}";
+  }
+  out << "]}" << std::endl;
+}
+
+}  // namespace
+
+void WriteQuoted(std::ostream& out, const std::string& text, bool json) {
+  out << '"';
+  for (char c : text) {
+    if (c == '"') {
+      out << (json ? "\\\"" : "\"\"");
+    } else if (c == '\\' && json) {
+      out << "\\\\";
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+void WriteReport(std::ostream& out, const RunReport& report,
+                 ReportFormat format) {
+  switch (format) {
+    case ReportFormat::kText:
+      WriteText(out, report, Lines(report));
+      break;
+    case ReportFormat::kCsv:
+      WriteCsvHeader(out);
+      WriteCsvRows(out, report);
+      break;
+    case ReportFormat::kJson:
+      WriteJson(out, report, Lines(report));
+      break;
+    default:
+      std::abort();
+  }
+}
+
+void WriteCsvHeader(std::ostream& out) {
+  out << "set,threads,scope,op,ops,seconds,ops_per_sec,samples,p50_ns,p99_ns,"
+         "p999_ns,max_ns,workload"
+      << std::endl;
+}
+
+void WriteCsvRows(std::ostream& out, const RunReport& report) {
+  for (const auto& line : Lines(report)) {
+    WriteQuoted(out, report.set, /*json=*/false);
+    out << ',' << report.threads << ',' << line.scope << ',' << line.op << ','
+        << line.ops << ',' << line.seconds << ',' << line.OpsPerSec() << ','
+        << line.latency.Count() << ',' << line.latency.Percentile(0.5) << ','
+        << line.latency.Percentile(0.99) << ','
+        << line.latency.Percentile(0.999) << ',' << line.latency.Max() << ',';
+    WriteQuoted(out, report.workload, /*json=*/false);
+    out << std::endl;
+  }
+}
+
+}  // namespace benchmark
@@ -0,0 +1,43 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "src/workload.h"
+
+namespace benchmark {
+
+// The outcome of running a workload on one set with some number of threads.
+struct RunReport {
+  std::string set;       // the benchmark's name, such as demo_striped
+  size_t threads = 0;
+  std::string workload;  // as given by DescribeWorkload()
+  // wall time from the release of the start barrier to the last join
+  double seconds = 0;
+  std::vector<WorkloadResult> results;  // one per thread
+  SetStats stats;  // as the set reported after the run
+};
+
+// Writes |report| in |format|. Every format gives the aggregate throughput and
+// latency percentiles of each type of operation and of all of them, and the
+// throughput of each thread. When built with HASH_SET_STATS, the text format
+// also summarises the set's statistics.
+void WriteReport(std::ostream& out, const RunReport& report,
+                 ReportFormat format);
+
+// The CSV form, split so that several reports can share one header. Each row
+// is one type of operation ("all", "contains", "add" or "remove") over one
+// scope ("all", or "thread<i>" with only "all" operations).
+void WriteCsvHeader(std::ostream& out);
+void WriteCsvRows(std::ostream& out, const RunReport& report);
+
+// Writes |text| as a string literal, escaped as JSON does if |json| is set and
+// as CSV does otherwise.
+void WriteQuoted(std::ostream& out, const std::string& text, bool json);
+
+}  // namespace benchmark
+
+#endif  // REPORT_H
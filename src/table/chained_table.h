@@ -0,0 +1,258 @@
+#ifndef TABLE_CHAINED_TABLE_H
+#define TABLE_CHAINED_TABLE_H
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "src/util/arena.h"
+#include "src/util/element_slot.h"
+#include "src/util/hash_policy.h"
+#include "src/util/inline_bucket.h"
+#include "src/util/prefetch.h"
+#include "src/util/set_stats.h"
+
+// Separate-chaining storage: one SmallBucket per bucket, which keeps a bucket
+// of up to the maximum load inline in its own cache line when the elements are
+// small enough, and is a std::vector otherwise. This is the original layout of
+// the sequential and coarse-grained sets and remains their default backend.
+// Not thread-safe; callers provide any synchronisation.
+//
+// |Hasher| hashes elements and |Policy| is a BucketPolicy from
+// src/util/hash_policy.h, fixing the load threshold, growth factor and bucket
+// indexing at compile time. |Allocator| provides the bucket storage; with an
+// ArenaAllocator from src/util/arena.h every rehash draws on a fresh arena and
+// releases the old buckets' memory in one step.
+//
+// Lookups take a T or any TransparentKey of |Hasher|. Elements whose hash is
+// cached (see kCacheHash) keep it beside them, so rehashing never calls
+// |Hasher|.
+template <typename T, typename Hasher = std::hash<T>,
+          typename Policy = DefaultBucketPolicy,
+          typename Allocator = std::allocator<T>>
+class ChainedTable {
+ public:
+  explicit ChainedTable(const size_t capacity)
+      : table_(MakeBuckets<Bucket>(Policy::Buckets(capacity),
+                                   arena_.allocator())),
+        new_table_(table_.get_allocator()),
+        min_buckets_(table_.size()),
+        set_size_(0) {
+    assert(capacity > 0);
+  }
+
+  using hasher = Hasher;
+
+  // Adds |elem|, copying or moving it in only if it was absent. Returns true
+  // if |elem| was absent, and false otherwise. Never resizes; callers check
+  // NeedsResize() afterwards.
+  template <ElementOf<T> U>
+  bool Add(U&& elem) {
+    size_t hash = Hash(elem);
+    return Add(std::forward<U>(elem), hash);
+  }
+
+  // Removes |key|. Returns true if |key| was present, and false otherwise.
+  template <LookupKey<T, Hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove(key, Hash(key));
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) const {
+    return Contains(key, Hash(key));
+  }
+
+  // Overloads taking |hash| == Hash(elem), computed up front by batch
+  // operations.
+  template <ElementOf<T> U>
+  bool Add(U&& elem, size_t hash) {
+    auto& bucket = Bucket_(hash);
+    stats_.RecordSearch(bucket);
+
+    // 3) return false on duplicate (loops over the elements in that bucket)
+    if (Slots::Find(bucket.begin(), bucket.end(), elem, hash) !=
+        bucket.end()) {
+      return false;
+    }
+
+    // 4) insert and update size if not present
+    bucket.push_back(Slots::Make(std::forward<U>(elem), hash));
+    set_size_++;
+    return true;
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  bool Remove(const Key& key, size_t hash) {
+    // compute bucket index & find bucket
+    auto& bucket = Bucket_(hash);
+    stats_.RecordSearch(bucket);
+
+    // find element position (returning early if doesn't exist)
+    auto i = Slots::Find(bucket.begin(), bucket.end(), key, hash);
+    if (i == bucket.end()) return false;
+
+    // remove element & decrement size
+    bucket.erase(i);
+    set_size_--;
+    return true;
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key, size_t hash) const {
+    auto& bucket = Bucket_(hash);
+    stats_.RecordSearch(bucket);
+
+    // return if found or not
+    return Slots::Find(bucket.begin(), bucket.end(), key, hash) !=
+           bucket.end();
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] size_t Hash(const Key& key) const {
+    return hasher_(key);
+  }
+
+  // Starts loading the bucket for |hash| into cache.
+  void Prefetch(size_t hash) const { PrefetchLine(&Bucket_(hash)); }
+
+  // Starts loading the elements of that bucket, which should itself have been
+  // prefetched a while before.
+  void PrefetchElements(size_t hash) const {
+    ::PrefetchElements(Bucket_(hash));
+  }
+
+  // Calls |fn(elem)| for every element, in bucket order.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (const auto& bucket : table_) {
+      for (const auto& slot : bucket) fn(Slots::Elem(slot));
+    }
+  }
+
+  [[nodiscard]] size_t Size() const { return set_size_; }
+
+  // Returns true once the average bucket holds more than the policy's maximum
+  // load.
+  [[nodiscard]] bool NeedsResize() const {
+    return Policy::NeedsResize(set_size_, table_.size());
+  }
+
+  // Grows the number of buckets by the policy's factor and rehashes every
+  // element.
+  void Resize() { Rehash_(Policy::Grow(table_.size())); }
+
+  // Resize() in steps, for callers that spread the rehash over several
+  // threads. BeginResize() allocates the grown table and returns the number
+  // of old buckets; MigrateBuckets() may then run concurrently on disjoint
+  // ranges of them, since growing by a whole factor sends each old bucket to
+  // its own set of new ones; EndResize() installs the new table. Only
+  // available when the allocator is thread-safe.
+  static constexpr bool kParallelResize = kThreadSafeAllocator<Allocator>;
+
+  size_t BeginResize() {
+    BeginRehash_(Policy::Grow(table_.size()));
+    return table_.size();
+  }
+
+  void MigrateBuckets(size_t begin, size_t end) {
+    for (size_t b = begin; b < end; b++) {
+      for (auto& slot : table_[b]) {
+        size_t i = Policy::Index(Slots::Hash(slot, hasher_), new_table_.size());
+        new_table_[i].push_back(std::move(slot));
+      }
+    }
+  }
+
+  void EndResize() {
+    // replace old table with new one, then drop the old arena and with it the
+    // storage of every old bucket
+    table_ = std::move(new_table_);
+    arena_ = std::move(*new_arena_);
+    new_arena_.reset();
+    stats_.EndResize();
+  }
+
+  // Returns true once the average load has fallen far enough below the
+  // maximum for the policy to shrink the table. Callers check this after
+  // removing.
+  [[nodiscard]] bool NeedsShrink() const {
+    return Policy::NeedsShrink(set_size_, table_.size(), min_buckets_);
+  }
+
+  // Shrinks the number of buckets by the policy's factor and rehashes every
+  // element.
+  void Shrink() { Rehash_(Policy::Shrink(table_.size())); }
+
+  // Grows the table up front so that it holds |n| elements without resizing.
+  // Never shrinks.
+  void Reserve(size_t n) {
+    size_t buckets = Policy::Reserved(n, table_.size());
+    if (buckets != table_.size()) Rehash_(buckets);
+  }
+
+  // Shrinks the table to the fewest buckets that hold the current elements,
+  // but no fewer than it was constructed with, and releases the spare
+  // capacity of every bucket. Always rehashes, so that an arena holding
+  // freed buckets is released too.
+  void ShrinkToFit() {
+    Rehash_(Policy::Fitted(set_size_, table_.size(), min_buckets_));
+    for (auto& bucket : table_) {
+      bucket.shrink_to_fit();
+    }
+  }
+
+  // Adds the searches and rehashes recorded so far to |stats|.
+  void CollectStats(SetStats& stats) const { stats_.Collect(stats); }
+
+ private:
+  using Slots = SlotTraits<T>;
+  using Slot = typename Slots::Slot;
+  using Bucket = SmallBucket<
+      Slot,
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>,
+      Policy::kMaxLoadFactor>;
+
+  // declared before the tables, which they must outlive
+  [[no_unique_address]] TableArena<Allocator> arena_;
+  std::optional<TableArena<Allocator>> new_arena_;  // set only while resizing
+  BucketArray<Bucket> table_;
+  BucketArray<Bucket> new_table_;  // empty unless resizing
+  size_t min_buckets_;  // the bucket count at construction
+  size_t set_size_;     // tracks the number of elements in the table
+  Hasher hasher_;
+  // searches run under a shared lock in the reader-writer set, hence mutable
+  [[no_unique_address]] mutable StatsRecorder stats_;
+
+  /**
+   * Returns the bucket associated with the hash.
+   */
+  Bucket& Bucket_(size_t hash) {
+    return table_[Policy::Index(hash, table_.size())];
+  }
+
+  const Bucket& Bucket_(size_t hash) const {
+    return table_[Policy::Index(hash, table_.size())];
+  }
+
+  /**
+   * Creates an empty table with the given number of buckets, backed by a fresh
+   * arena, for the elements to move into.
+   */
+  void BeginRehash_(size_t buckets) {
+    stats_.BeginResize();
+    new_arena_.emplace();
+    new_table_ = MakeBuckets<Bucket>(buckets, new_arena_->allocator());
+  }
+
+  void Rehash_(size_t buckets) {
+    BeginRehash_(buckets);
+    MigrateBuckets(0, table_.size());
+    EndResize();
+  }
+};
+
+#endif  // TABLE_CHAINED_TABLE_H
@@ -0,0 +1,161 @@
+#ifndef TABLE_FLAT_GROUP_H
+#define TABLE_FLAT_GROUP_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Control bytes of a FlatTable. Full slots store a 7-bit hash tag, so they are
+// non-negative, while empty and deleted slots are negative.
+inline constexpr int8_t kCtrlEmpty = -128;
+inline constexpr int8_t kCtrlDeleted = -2;
+
+// A group is a window of control bytes that a FlatTable probes in one step.
+// Every implementation provides:
+//   kWidth  - the number of control bytes examined per step;
+//   kShift  - log2 of the number of mask bits per slot, so that the slot of the
+//             lowest set bit is countr_zero(mask) >> kShift;
+//   Match(h2), MatchEmpty(), MatchEmptyOrDeleted() - masks of the slots with
+//             that control byte. Match() may report extra full slots, but
+//             never an empty or deleted one, so callers compare the element.
+
+// Portable fallback, matching eight bytes at a time with word-wide bit tricks.
+// Each matching slot i sets bit 8*i+7.
+struct FlatGroupPortable {
+  static_assert(std::endian::native == std::endian::little,
+                "slot order within a group assumes a little-endian load");
+
+  static constexpr size_t kWidth = 8;
+  static constexpr int kShift = 3;
+
+  explicit FlatGroupPortable(const int8_t* ctrl) {
+    std::memcpy(&ctrl_, ctrl, kWidth);
+  }
+
+  [[nodiscard]] uint64_t Match(int8_t h2) const {
+    uint64_t x = ctrl_ ^ (kLsbs * static_cast<uint8_t>(h2));
+    return (x - kLsbs) & ~x & kMsbs;
+  }
+
+  // kCtrlEmpty is the only negative control byte with bit 1 clear.
+  [[nodiscard]] uint64_t MatchEmpty() const {
+    return ctrl_ & ~(ctrl_ << 6) & kMsbs;
+  }
+
+  // Empty and deleted control bytes have bit 7 set and bit 0 clear.
+  [[nodiscard]] uint64_t MatchEmptyOrDeleted() const {
+    return ctrl_ & ~(ctrl_ << 7) & kMsbs;
+  }
+
+  static constexpr uint64_t kLsbs = 0x0101010101010101ULL;
+  static constexpr uint64_t kMsbs = 0x8080808080808080ULL;
+
+  uint64_t ctrl_;
+};
+
+#if defined(__SSE2__)
+
+// Sixteen slots per step: one byte compare and one movemask, one bit per slot.
+struct FlatGroupSse2 {
+  static constexpr size_t kWidth = 16;
+  static constexpr int kShift = 0;
+
+  explicit FlatGroupSse2(const int8_t* ctrl)
+      : ctrl_(_mm_loadu_si128(static_cast<const __m128i*>(
+            static_cast<const void*>(ctrl)))) {}
+
+  [[nodiscard]] uint64_t Match(int8_t h2) const {
+    return Mask_(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_));
+  }
+
+  [[nodiscard]] uint64_t MatchEmpty() const { return Match(kCtrlEmpty); }
+
+  // the sign bit alone tells empty and deleted slots from full ones
+  [[nodiscard]] uint64_t MatchEmptyOrDeleted() const { return Mask_(ctrl_); }
+
+  static uint64_t Mask_(__m128i bytes) {
+    return static_cast<uint16_t>(_mm_movemask_epi8(bytes));
+  }
+
+  __m128i ctrl_;
+};
+
+#endif  // defined(__SSE2__)
+
+#if defined(__AVX2__)
+
+// Thirty-two slots per step, one bit per slot. Not the default: the wider
+// loads straddle cache lines twice as often, which can cost more than the
+// extra slots per step save. Select it explicitly to compare.
+struct FlatGroupAvx2 {
+  static constexpr size_t kWidth = 32;
+  static constexpr int kShift = 0;
+
+  explicit FlatGroupAvx2(const int8_t* ctrl)
+      : ctrl_(_mm256_loadu_si256(static_cast<const __m256i*>(
+            static_cast<const void*>(ctrl)))) {}
+
+  [[nodiscard]] uint64_t Match(int8_t h2) const {
+    return Mask_(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl_));
+  }
+
+  [[nodiscard]] uint64_t MatchEmpty() const { return Match(kCtrlEmpty); }
+
+  [[nodiscard]] uint64_t MatchEmptyOrDeleted() const { return Mask_(ctrl_); }
+
+  static uint64_t Mask_(__m256i bytes) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(bytes));
+  }
+
+  __m256i ctrl_;
+};
+
+#endif  // defined(__AVX2__)
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+
+// Eight slots per step. NEON has no movemask, so compare results are read back
+// as a 64-bit lane and, like the portable group, each slot i sets bit 8*i+7.
+struct FlatGroupNeon {
+  static constexpr size_t kWidth = 8;
+  static constexpr int kShift = 3;
+
+  explicit FlatGroupNeon(const int8_t* ctrl) : ctrl_(vld1_s8(ctrl)) {}
+
+  [[nodiscard]] uint64_t Match(int8_t h2) const {
+    return Mask_(vceq_s8(ctrl_, vdup_n_s8(h2)));
+  }
+
+  [[nodiscard]] uint64_t MatchEmpty() const { return Match(kCtrlEmpty); }
+
+  [[nodiscard]] uint64_t MatchEmptyOrDeleted() const {
+    return Mask_(vcltz_s8(ctrl_));
+  }
+
+  static uint64_t Mask_(uint8x8_t bytes) {
+    return vget_lane_u64(vreinterpret_u64_u8(bytes), 0) &
+           FlatGroupPortable::kMsbs;
+  }
+
+  int8x8_t ctrl_;
+};
+
+#endif  // defined(__ARM_NEON) && defined(__aarch64__)
+
+// The default group for the target, chosen at compile time.
+#if defined(__SSE2__)
+using FlatGroup = FlatGroupSse2;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+using FlatGroup = FlatGroupNeon;
+#else
+using FlatGroup = FlatGroupPortable;
+#endif
+
+#endif  // TABLE_FLAT_GROUP_H
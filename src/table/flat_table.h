@@ -0,0 +1,344 @@
+#ifndef TABLE_FLAT_TABLE_H
+#define TABLE_FLAT_TABLE_H
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "src/table/flat_group.h"
+#include "src/util/element_slot.h"
+#include "src/util/hash_policy.h"
+#include "src/util/prefetch.h"
+#include "src/util/set_file.h"
+#include "src/util/set_stats.h"
+
+template <typename T, typename Group, typename Hasher>
+class MappedFlatTable;
+
+// Open-addressing storage in the style of SwissTable. Elements live inline in
+// one flat array of slots, alongside an array of one-byte control words that
+// record whether each slot is empty, deleted (a tombstone), or full, in which
+// case the byte holds 7 bits of the element's hash. Lookups scan the control
+// bytes a group at a time and only compare elements whose tag matches, so a
+// hit typically touches one control line and one slot line. Not thread-safe;
+// callers provide any synchronisation.
+//
+// |Group| is one of the implementations in src/table/flat_group.h. The
+// default, FlatGroup, is the SIMD group chosen for the target at compile time,
+// falling back to a portable implementation. |Hasher| hashes elements; its
+// result is always mixed, so the table is already a power of two indexed by
+// mask and takes no BucketPolicy. Lookups and cached hashes are as for
+// ChainedTable; a cached hash is the mixed one.
+//
+// |T| must be default-constructible, since unused slots hold a T().
+template <typename T, typename Group = FlatGroup,
+          typename Hasher = std::hash<T>>
+class FlatTable {
+  static_assert(std::is_default_constructible_v<T>,
+                "FlatTable stores elements inline and needs a T()");
+
+ public:
+  explicit FlatTable(const size_t capacity)
+      : min_capacity_(std::max(std::bit_ceil(capacity), kGroupWidth)),
+        set_size_(0) {
+    assert(capacity > 0);
+    Init_(min_capacity_);
+  }
+
+  using hasher = Hasher;
+
+  // Adds |elem|, copying or moving it in only if it was absent. Returns true
+  // if |elem| was absent, and false otherwise. Grows the table first if it has
+  // no free slot left, so it never overfills even when the caller defers
+  // NeedsResize().
+  template <ElementOf<T> U>
+  bool Add(U&& elem) {
+    size_t hash = Hash(elem);
+    return Add(std::forward<U>(elem), hash);
+  }
+
+  // Removes |key|. Returns true if |key| was present, and false otherwise.
+  template <LookupKey<T, Hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove(key, Hash(key));
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) const {
+    return Contains(key, Hash(key));
+  }
+
+  // Overloads taking |hash| == Hash(elem), computed up front by batch
+  // operations.
+  template <ElementOf<T> U>
+  bool Add(U&& elem, size_t hash) {
+    // return false on duplicate
+    if (Find_(elem, hash) != kNotFound) return false;
+
+    // make room if every slot allowed by the maximum load is in use
+    if (growth_left_ == 0) Resize();
+
+    // claim the first empty or deleted slot on the probe sequence
+    size_t i = FindFree_(hash);
+    if (ctrl_[i] == kCtrlEmpty) growth_left_--;
+    SetCtrl_(i, H2_(hash));
+    slots_[i] = Slots::Make(std::forward<U>(elem), hash);
+    set_size_++;
+    return true;
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  bool Remove(const Key& key, size_t hash) {
+    size_t i = Find_(key, hash);
+    if (i == kNotFound) return false;
+
+    // leave a tombstone so that probe sequences passing through this slot
+    // still reach the elements placed beyond it
+    SetCtrl_(i, kCtrlDeleted);
+    slots_[i] = Slot();
+    set_size_--;
+    return true;
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key, size_t hash) const {
+    return Find_(key, hash) != kNotFound;
+  }
+
+  /**
+   * Returns a well-mixed hash of the element. std::hash of an integer is
+   * usually the identity, which would place consecutive keys in the same group
+   * and leave the tag bits constant.
+   */
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] size_t Hash(const Key& key) const {
+    return Mix_(hasher_, key);
+  }
+
+  // Starts loading the first control group and slot probed for |hash|.
+  void Prefetch(size_t hash) const {
+    size_t offset = H1_(hash) & (slots_.size() - 1);
+    PrefetchLine(&ctrl_[offset]);
+    PrefetchLine(&slots_[offset]);
+  }
+
+  // Calls |fn(elem)| for every element, in slot order.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (ctrl_[i] >= 0) fn(Slots::Elem(slots_[i]));
+    }
+  }
+
+  [[nodiscard]] size_t Size() const { return set_size_; }
+
+  // Returns true once every slot allowed by the 7/8 maximum load, counting
+  // tombstones, is in use.
+  [[nodiscard]] bool NeedsResize() const { return growth_left_ == 0; }
+
+  // Rehashes every element, dropping tombstones. The slot count doubles unless
+  // tombstones make up most of the used slots, in which case it is kept.
+  void Resize() {
+    size_t capacity = slots_.size();
+    Rehash_(set_size_ * 2 <= MaxLoad_(capacity) ? capacity : capacity * 2);
+  }
+
+  // Returns true once fewer than a quarter of the slots are full, so that
+  // halving the slot count leaves the table at most half full. Callers check
+  // this after removing.
+  [[nodiscard]] bool NeedsShrink() const {
+    return slots_.size() > min_capacity_ && set_size_ < slots_.size() / 4;
+  }
+
+  // Halves the slot count, rehashing every element and dropping tombstones.
+  void Shrink() { Rehash_(slots_.size() / 2); }
+
+  // Grows the table up front so that it holds |n| elements without resizing.
+  // Never shrinks.
+  void Reserve(size_t n) {
+    size_t capacity = Fit_(n, slots_.size());
+    if (capacity != slots_.size()) Rehash_(capacity);
+  }
+
+  // Rehashes into the fewest slots that hold the current elements, but no
+  // fewer than the table was constructed with, dropping every tombstone.
+  void ShrinkToFit() { Rehash_(Fit_(set_size_, min_capacity_)); }
+
+  // Adds the lookups, by the number of groups each probed, and the rehashes
+  // recorded so far to |stats|.
+  void CollectStats(SetStats& stats) const { stats_.Collect(stats); }
+
+  // Writes the control bytes and slots to |path| as they are, tombstones
+  // included, for MappedFlatTable to search in place. Returns false,
+  // describing the failure in |error|, if writing fails.
+  bool Save(const std::string& path, std::string& error) const
+    requires std::is_trivially_copyable_v<T>
+  {
+    SetFileHeader header;
+    header.kind = SetFileKind::kFlatTable;
+    header.record_size = sizeof(Slot);
+    header.group_width = kGroupWidth;
+    header.count = set_size_;
+    header.slots = slots_.size();
+    auto hash_of = [this](const T& elem) { return Hash(elem); };
+    header.hash_check =
+        HashCheck_(ctrl_.data(), slots_.data(), slots_.size(), hash_of);
+    return WriteSetFile(path, header,
+                        {std::as_bytes(std::span(ctrl_)),
+                         std::as_bytes(std::span(slots_))},
+                        error);
+  }
+
+ private:
+  friend class MappedFlatTable<T, Group, Hasher>;
+
+  using Slots = SlotTraits<T>;
+  using Slot = typename Slots::Slot;
+
+  static constexpr size_t kNotFound = SIZE_MAX;
+
+  static constexpr size_t kGroupWidth = Group::kWidth;
+
+  // One control byte per slot, followed by a copy of the first kGroupWidth
+  // bytes so that a group starting near the end never has to wrap around.
+  std::vector<int8_t> ctrl_;
+  std::vector<Slot> slots_;  // size is a power of two, at least kGroupWidth
+  size_t min_capacity_;   // the slot count at construction
+  size_t set_size_;       // tracks the number of elements in the table
+  size_t growth_left_;    // empty slots that may still be filled
+  Hasher hasher_;
+  // lookups run under a shared lock in the reader-writer set, hence mutable
+  [[no_unique_address]] mutable StatsRecorder stats_;
+
+  static size_t MaxLoad_(size_t capacity) { return capacity - capacity / 8; }
+
+  /**
+   * Returns the smallest power-of-two multiple of |capacity| that holds |n|
+   * elements with a free slot to spare under the maximum load.
+   */
+  static size_t Fit_(size_t n, size_t capacity) {
+    while (MaxLoad_(capacity) <= n) capacity *= 2;
+    return capacity;
+  }
+
+  // The high bits choose where probing starts; the low 7 are the stored tag.
+  static size_t H1_(size_t hash) { return hash >> 7; }
+  static int8_t H2_(size_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+
+  template <typename Key>
+  static size_t Mix_(const Hasher& hasher, const Key& key) {
+    return static_cast<size_t>(Mix64(static_cast<uint64_t>(hasher(key))));
+  }
+
+  /**
+   * Returns the hash of the first element among |capacity| slots, as
+   * |hash_of| computes it, or 0 if there is none: the check that a saved
+   * image hashes as the table reading it does.
+   */
+  template <typename HashOf>
+  static size_t HashCheck_(const int8_t* ctrl, const Slot* slots,
+                           size_t capacity, const HashOf& hash_of) {
+    for (size_t i = 0; i < capacity; i++) {
+      if (ctrl[i] >= 0) return hash_of(Slots::Elem(slots[i]));
+    }
+    return 0;
+  }
+
+  /**
+   * Returns the offset within its group of the lowest slot in a match mask.
+   */
+  static size_t SlotIndex_(uint64_t match) {
+    return static_cast<size_t>(std::countr_zero(match) >> Group::kShift);
+  }
+
+  void Init_(size_t capacity) {
+    ctrl_.assign(capacity + kGroupWidth, kCtrlEmpty);
+    slots_ = std::vector<Slot>(capacity);
+    growth_left_ = MaxLoad_(capacity) - set_size_;
+  }
+
+  void SetCtrl_(size_t i, int8_t ctrl) {
+    ctrl_[i] = ctrl;
+    if (i < kGroupWidth) ctrl_[slots_.size() + i] = ctrl;
+  }
+
+  template <typename Key>
+  size_t Find_(const Key& key, size_t hash) const {
+    return Find_(ctrl_.data(), slots_.data(), slots_.size(), key, hash,
+                 stats_);
+  }
+
+  /**
+   * Returns the slot holding |key| among |capacity| slots laid out as ctrl_
+   * and slots_ are, or kNotFound. Groups are probed at triangular offsets
+   * from H1, which visits every group position when the capacity is a power
+   * of two. The maximum load guarantees an empty slot, so the probe always
+   * terminates.
+   */
+  template <typename Key>
+  static size_t Find_(const int8_t* ctrl, const Slot* slots, size_t capacity,
+                      const Key& key, size_t hash, StatsRecorder& stats) {
+    size_t mask = capacity - 1;
+    size_t offset = H1_(hash) & mask;
+    int8_t h2 = H2_(hash);
+    for (size_t step = kGroupWidth, groups = 1;; step += kGroupWidth) {
+      Group group(&ctrl[offset]);
+      for (auto match = group.Match(h2); match != 0; match &= match - 1) {
+        size_t i = (offset + SlotIndex_(match)) & mask;
+        if (Slots::Matches(slots[i], key, hash)) {
+          stats.RecordProbe(groups);
+          return i;
+        }
+      }
+      if (group.MatchEmpty() != 0) {
+        stats.RecordProbe(groups);
+        return kNotFound;
+      }
+      offset = (offset + step) & mask;
+      groups++;
+    }
+  }
+
+  /**
+   * Returns the first empty or deleted slot on the probe sequence of |hash|.
+   */
+  size_t FindFree_(size_t hash) const {
+    size_t mask = slots_.size() - 1;
+    size_t offset = H1_(hash) & mask;
+    for (size_t step = kGroupWidth;; step += kGroupWidth) {
+      auto match = Group(&ctrl_[offset]).MatchEmptyOrDeleted();
+      if (match != 0) {
+        return (offset + SlotIndex_(match)) & mask;
+      }
+      offset = (offset + step) & mask;
+    }
+  }
+
+  void Rehash_(size_t new_capacity) {
+    stats_.BeginResize();
+
+    // 1) swap in an empty table with the requested number of slots
+    auto old_ctrl = std::move(ctrl_);
+    auto old_slots = std::move(slots_);
+    Init_(new_capacity);
+
+    // 2) move every full slot across; no duplicates, so no lookups needed
+    for (size_t i = 0; i < old_slots.size(); i++) {
+      if (old_ctrl[i] < 0) continue;
+      size_t hash = Slots::Hash(old_slots[i],
+                                [this](const T& elem) { return Hash(elem); });
+      size_t j = FindFree_(hash);
+      SetCtrl_(j, H2_(hash));
+      slots_[j] = std::move(old_slots[i]);
+    }
+    stats_.EndResize();
+  }
+};
+
+#endif  // TABLE_FLAT_TABLE_H
@@ -0,0 +1,290 @@
+#ifndef TABLE_INCREMENTAL_TABLE_H
+#define TABLE_INCREMENTAL_TABLE_H
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "src/util/arena.h"
+#include "src/util/element_slot.h"
+#include "src/util/hash_policy.h"
+#include "src/util/inline_bucket.h"
+#include "src/util/prefetch.h"
+#include "src/util/set_stats.h"
+
+// Separate-chaining storage that resizes incrementally. Resize() only
+// allocates the doubled bucket array; the elements are then migrated
+// |kBucketsPerStep| old buckets at a time by each later Add() or Remove(), so
+// no single call pays for rehashing the whole table. While a migration is in
+// progress every element is in exactly one of the two tables: its old bucket
+// if that bucket has not been migrated yet, and the new table otherwise.
+// Contains() never migrates, so concurrent lookups under a shared lock are
+// safe. Not thread-safe otherwise; callers provide any synchronisation.
+//
+// |Hasher|, |Policy| and |Allocator|, lookups and cached hashes are as for
+// ChainedTable. Each of the two
+// tables has its own arena, and the old one is released as soon as the
+// migration drains it.
+template <typename T, size_t kBucketsPerStep = 8,
+          typename Hasher = std::hash<T>, typename Policy = DefaultBucketPolicy,
+          typename Allocator = std::allocator<T>>
+class IncrementalTable {
+  static_assert(kBucketsPerStep > 0, "migration must make progress");
+
+ public:
+  explicit IncrementalTable(const size_t capacity)
+      : table_(MakeBuckets<Bucket>(Policy::Buckets(capacity),
+                                   arena_.allocator())),
+        old_table_(table_.get_allocator()),
+        min_buckets_(table_.size()),
+        migrated_(0),
+        set_size_(0) {
+    assert(capacity > 0);
+  }
+
+  using hasher = Hasher;
+
+  // Adds |elem|, copying or moving it in only if it was absent. Returns true
+  // if |elem| was absent, and false otherwise.
+  template <ElementOf<T> U>
+  bool Add(U&& elem) {
+    size_t hash = Hash(elem);
+    return Add(std::forward<U>(elem), hash);
+  }
+
+  // Removes |key|. Returns true if |key| was present, and false otherwise.
+  template <LookupKey<T, Hasher> Key>
+  bool Remove(const Key& key) {
+    return Remove(key, Hash(key));
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) const {
+    return Contains(key, Hash(key));
+  }
+
+  // Overloads taking |hash| == Hash(elem), computed up front by batch
+  // operations.
+  template <ElementOf<T> U>
+  bool Add(U&& elem, size_t hash) {
+    MigrateStep_();
+
+    auto& bucket = Bucket_(hash);
+    stats_.RecordSearch(bucket);
+
+    // return false on duplicate (loops over the elements in that bucket)
+    if (Slots::Find(bucket.begin(), bucket.end(), elem, hash) !=
+        bucket.end()) {
+      return false;
+    }
+
+    // insert and update size if not present
+    bucket.push_back(Slots::Make(std::forward<U>(elem), hash));
+    set_size_++;
+    return true;
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  bool Remove(const Key& key, size_t hash) {
+    MigrateStep_();
+
+    auto& bucket = Bucket_(hash);
+    stats_.RecordSearch(bucket);
+
+    // find element position (returning early if doesn't exist)
+    auto i = Slots::Find(bucket.begin(), bucket.end(), key, hash);
+    if (i == bucket.end()) return false;
+
+    // remove element & decrement size
+    bucket.erase(i);
+    set_size_--;
+    return true;
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key, size_t hash) const {
+    auto& bucket = Bucket_(hash);
+    stats_.RecordSearch(bucket);
+
+    // return if found or not
+    return Slots::Find(bucket.begin(), bucket.end(), key, hash) !=
+           bucket.end();
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] size_t Hash(const Key& key) const {
+    return hasher_(key);
+  }
+
+  // Starts loading the bucket for |hash| into cache.
+  void Prefetch(size_t hash) const { PrefetchLine(&Bucket_(hash)); }
+
+  // Starts loading the elements of that bucket, which should itself have been
+  // prefetched a while before.
+  void PrefetchElements(size_t hash) const {
+    ::PrefetchElements(Bucket_(hash));
+  }
+
+  // Calls |fn(elem)| for every element: those of the old buckets not yet
+  // migrated, then those of the new table.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (size_t b = migrated_; b < old_table_.size(); b++) {
+      for (const auto& slot : old_table_[b]) fn(Slots::Elem(slot));
+    }
+    for (const auto& bucket : table_) {
+      for (const auto& slot : bucket) fn(Slots::Elem(slot));
+    }
+  }
+
+  [[nodiscard]] size_t Size() const { return set_size_; }
+
+  // Returns true once the average bucket holds more than the policy's maximum
+  // load and no migration is already under way.
+  [[nodiscard]] bool NeedsResize() const {
+    return old_table_.empty() && Policy::NeedsResize(set_size_, table_.size());
+  }
+
+  // Starts migrating to a table with more buckets, grown by the policy's
+  // factor. Any migration still in progress is completed first.
+  void Resize() {
+    FinishMigration_();
+    StartMigration_(Policy::Grow(table_.size()));
+  }
+
+  // Returns true once the average load has fallen far enough below the
+  // maximum for the policy to shrink the table and no migration is already
+  // under way. Callers check this after removing.
+  [[nodiscard]] bool NeedsShrink() const {
+    return old_table_.empty() &&
+           Policy::NeedsShrink(set_size_, table_.size(), min_buckets_);
+  }
+
+  // Starts migrating to a table with fewer buckets, shrunk by the policy's
+  // factor. Any migration still in progress is completed first.
+  void Shrink() {
+    FinishMigration_();
+    StartMigration_(Policy::Shrink(table_.size()));
+  }
+
+  // Grows the table up front so that it holds |n| elements without resizing.
+  // Never shrinks. Unlike Resize(), the whole migration happens here.
+  void Reserve(size_t n) {
+    FinishMigration_();
+    size_t buckets = Policy::Reserved(n, table_.size());
+    if (buckets == table_.size()) return;
+    StartMigration_(buckets);
+    FinishMigration_();
+  }
+
+  // Shrinks the table to the fewest buckets that hold the current elements,
+  // but no fewer than it was constructed with, and releases the spare
+  // capacity of every bucket. The whole migration happens here.
+  void ShrinkToFit() {
+    FinishMigration_();
+    size_t buckets = Policy::Fitted(set_size_, table_.size(), min_buckets_);
+    if (buckets != table_.size()) {
+      StartMigration_(buckets);
+      FinishMigration_();
+    }
+    for (auto& bucket : table_) {
+      bucket.shrink_to_fit();
+    }
+  }
+
+  // Adds the searches and migrations recorded so far to |stats|. A
+  // migration lasts from its start until the old table is drained, so its
+  // duration spans the operations that carried it out.
+  void CollectStats(SetStats& stats) const { stats_.Collect(stats); }
+
+ private:
+  using Slots = SlotTraits<T>;
+  using Slot = typename Slots::Slot;
+  using Bucket = SmallBucket<
+      Slot,
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>,
+      Policy::kMaxLoadFactor>;
+
+  // declared before the tables, which they must outlive
+  [[no_unique_address]] TableArena<Allocator> arena_;
+  std::optional<TableArena<Allocator>> old_arena_;  // set only while migrating
+  BucketArray<Bucket> table_;      // the table being migrated to
+  BucketArray<Bucket> old_table_;  // empty unless migrating
+  size_t min_buckets_;  // the bucket count at construction
+  size_t migrated_;     // number of leading old buckets already migrated
+  size_t set_size_;     // tracks the number of elements in both tables
+  Hasher hasher_;
+  // searches run under a shared lock in the reader-writer set, hence mutable
+  [[no_unique_address]] mutable StatsRecorder stats_;
+
+  /**
+   * Returns the bucket currently holding elements with the hash, or that they
+   * would be inserted into.
+   */
+  Bucket& Bucket_(size_t hash) {
+    if (!old_table_.empty()) {
+      size_t i = Policy::Index(hash, old_table_.size());
+      if (i >= migrated_) return old_table_[i];
+    }
+    return table_[Policy::Index(hash, table_.size())];
+  }
+
+  const Bucket& Bucket_(size_t hash) const {
+    if (!old_table_.empty()) {
+      size_t i = Policy::Index(hash, old_table_.size());
+      if (i >= migrated_) return old_table_[i];
+    }
+    return table_[Policy::Index(hash, table_.size())];
+  }
+
+  /**
+   * Makes the current table the old one and starts migrating its elements to
+   * a new table of |buckets|. No migration may be in progress.
+   */
+  void StartMigration_(size_t buckets) {
+    assert(old_table_.empty());
+    stats_.BeginResize();
+    old_table_ = std::move(table_);
+    old_arena_.emplace(std::move(arena_));
+    arena_ = TableArena<Allocator>();
+    table_ = MakeBuckets<Bucket>(buckets, arena_.allocator());
+    migrated_ = 0;
+  }
+
+  void FinishMigration_() {
+    while (!old_table_.empty()) {
+      MigrateStep_();
+    }
+  }
+
+  /**
+   * Moves the next |kBucketsPerStep| old buckets into the new table, dropping
+   * the old table once it has been fully drained.
+   */
+  void MigrateStep_() {
+    if (old_table_.empty()) return;
+
+    size_t end = std::min(migrated_ + kBucketsPerStep, old_table_.size());
+    for (; migrated_ < end; migrated_++) {
+      auto& bucket = old_table_[migrated_];
+      for (auto& slot : bucket) {
+        size_t i = Policy::Index(Slots::Hash(slot, hasher_), table_.size());
+        table_[i].push_back(std::move(slot));
+      }
+      // release the bucket's memory now rather than with the whole table
+      Bucket(bucket.get_allocator()).swap(bucket);
+    }
+
+    // once drained, drop the old table and then its arena
+    if (migrated_ == old_table_.size()) {
+      BucketArray<Bucket>(old_table_.get_allocator()).swap(old_table_);
+      old_arena_.reset();
+      stats_.EndResize();
+    }
+  }
+};
+
+#endif  // TABLE_INCREMENTAL_TABLE_H
@@ -0,0 +1,122 @@
+#ifndef TABLE_MAPPED_FLAT_TABLE_H
+#define TABLE_MAPPED_FLAT_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+
+#include "src/table/flat_group.h"
+#include "src/table/flat_table.h"
+#include "src/util/element_slot.h"
+#include "src/util/hash_policy.h"
+#include "src/util/set_file.h"
+#include "src/util/set_stats.h"
+
+// A FlatTable saved by FlatTable::Save(), searched in place through a
+// read-only mapping of the file. Opening it neither reads nor rehashes the
+// elements: the kernel pages in only the groups and slots that lookups touch,
+// so a table of any size is ready at once. Lookups are those of a FlatTable
+// of the same parameters, which must be those it was saved with; the header
+// records the slot size, group width and a hash check, and Open() refuses a
+// file that does not match.
+//
+// Read-only, so any number of threads may search it concurrently.
+template <typename T, typename Group = FlatGroup,
+          typename Hasher = std::hash<T>>
+class MappedFlatTable {
+  using Table = FlatTable<T, Group, Hasher>;
+  using Slots = typename Table::Slots;
+  using Slot = typename Table::Slot;
+
+ public:
+  using hasher = Hasher;
+
+  MappedFlatTable() = default;
+
+  // Maps the table saved at |path|, replacing any mapped before. Returns
+  // false, describing the mismatch in |error|, if the file is not a FlatTable
+  // saved with these parameters and an alike hasher.
+  bool Open(const std::string& path, std::string& error) {
+    ctrl_ = {};
+    slots_ = {};
+    set_size_ = 0;
+    if (!file_.Open(path, SetFileKind::kFlatTable, sizeof(Slot), error)) {
+      return false;
+    }
+
+    const auto& header = file_.Header();
+    size_t slots = header.slots;
+    if (header.group_width != Table::kGroupWidth) {
+      error = path + " was saved with groups of " +
+              std::to_string(header.group_width) + " slots, not " +
+              std::to_string(Table::kGroupWidth);
+      return false;
+    }
+    if (slots < Table::kGroupWidth || (slots & (slots - 1)) != 0 ||
+        header.count >= slots) {
+      error = path + " has an invalid slot count";
+      return false;
+    }
+    std::span<const int8_t> ctrl;
+    std::span<const Slot> elems;
+    if (!file_.Next(slots + Table::kGroupWidth, ctrl, error) ||
+        !file_.Next(slots, elems, error)) {
+      return false;
+    }
+    auto hash_of = [this](const T& elem) { return Hash(elem); };
+    if (Table::HashCheck_(ctrl.data(), elems.data(), slots, hash_of) !=
+        header.hash_check) {
+      error = path + " was saved by a table hashing differently";
+      return false;
+    }
+
+    ctrl_ = ctrl;
+    slots_ = elems;
+    set_size_ = header.count;
+    return true;
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key) const {
+    return Contains(key, Hash(key));
+  }
+
+  // As for FlatTable.
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] bool Contains(const Key& key, size_t hash) const {
+    if (slots_.empty()) return false;
+    return Table::Find_(ctrl_.data(), slots_.data(), slots_.size(), key, hash,
+                        stats_) != Table::kNotFound;
+  }
+
+  template <LookupKey<T, Hasher> Key>
+  [[nodiscard]] size_t Hash(const Key& key) const {
+    return Table::Mix_(hasher_, key);
+  }
+
+  // Calls |fn(elem)| for every element, in slot order.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (ctrl_[i] >= 0) fn(Slots::Elem(slots_[i]));
+    }
+  }
+
+  [[nodiscard]] size_t Size() const { return set_size_; }
+
+  // Adds the lookups, by the number of groups each probed, to |stats|.
+  void CollectStats(SetStats& stats) const { stats_.Collect(stats); }
+
+ private:
+  MappedSetFile file_;
+  std::span<const int8_t> ctrl_;  // empty until a file is open
+  std::span<const Slot> slots_;
+  size_t set_size_ = 0;
+  Hasher hasher_;
+  // lookups run concurrently and record their probes, hence mutable
+  [[no_unique_address]] mutable StatsRecorder stats_;
+};
+
+#endif  // TABLE_MAPPED_FLAT_TABLE_H
@@ -0,0 +1,38 @@
+#ifndef UTIL_AFFINITY_H
+#define UTIL_AFFINITY_H
+
+#include <cstddef>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Pins the calling thread to the |index|th CPU it may run on, wrapping around
+// past the last, so that benchmark threads spread over distinct cores. Returns
+// false where pinning is unsupported or fails, leaving the thread unpinned.
+inline bool PinThisThread(size_t index) {
+#if defined(__linux__)
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return false;
+  auto count = static_cast<size_t>(CPU_COUNT(&allowed));
+  if (count == 0) return false;
+
+  size_t target = index % count;
+  for (size_t cpu = 0; cpu < static_cast<size_t>(CPU_SETSIZE); cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) continue;
+    if (target-- == 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+  }
+  return false;
+#else
+  (void)index;
+  return false;
+#endif
+}
+
+#endif  // UTIL_AFFINITY_H
@@ -0,0 +1,210 @@
+#ifndef UTIL_ARENA_H
+#define UTIL_ARENA_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "src/util/cache_line.h"
+#include "src/util/thread_index.h"
+
+// A pool allocator for small blocks. Requests are rounded up to a power-of-two
+// size class and served from that class's free list, or else bumped out of
+// the current chunk; freed blocks go back on their class's free list for
+// reuse. Chunks are only returned to the system when the arena is destroyed,
+// all at once. Blocks larger than kMaxPooled, or more aligned than
+// kMinClass, bypass the pool. Not thread-safe; see ShardedArena.
+class BumpArena {
+ public:
+  BumpArena() = default;
+  BumpArena(const BumpArena&) = delete;
+  BumpArena& operator=(const BumpArena&) = delete;
+
+  ~BumpArena() {
+    for (void* chunk : chunks_) {
+      ::operator delete(chunk);
+    }
+  }
+
+  void* Allocate(size_t bytes, size_t align) {
+    if (bytes > kMaxPooled || align > kMinClass) {
+      return ::operator new(bytes, std::align_val_t(align));
+    }
+
+    // 1) reuse a freed block of the same class if there is one
+    size_t c = Class_(bytes);
+    if (FreeBlock* block = free_[c]; block != nullptr) {
+      free_[c] = block->next;
+      return block;
+    }
+
+    // 2) otherwise bump a new block out of the current chunk, starting a new
+    //    chunk if it is exhausted (the unused tail is simply lost)
+    size_t size = kMinClass << c;
+    if (static_cast<size_t>(end_ - next_) < size) {
+      next_ = static_cast<std::byte*>(::operator new(kChunkSize));
+      end_ = next_ + kChunkSize;
+      chunks_.push_back(next_);
+    }
+    void* block = next_;
+    next_ += size;
+    return block;
+  }
+
+  void Deallocate(void* ptr, size_t bytes, size_t align) {
+    if (bytes > kMaxPooled || align > kMinClass) {
+      ::operator delete(ptr, std::align_val_t(align));
+      return;
+    }
+
+    size_t c = Class_(bytes);
+    free_[c] = ::new (ptr) FreeBlock{free_[c]};
+  }
+
+ private:
+  // the smallest size class, which also bounds the alignment chunks provide
+  static constexpr size_t kMinClass = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+  static constexpr size_t kMaxPooled = 4096;
+  static constexpr size_t kClasses =
+      std::bit_width(kMaxPooled / kMinClass);  // kMinClass to kMaxPooled
+  static constexpr size_t kChunkSize = 16 * 1024;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  std::array<FreeBlock*, kClasses> free_{};
+  std::vector<void*> chunks_;
+  std::byte* next_ = nullptr;  // the unused part of the current chunk
+  std::byte* end_ = nullptr;
+
+  static size_t Class_(size_t bytes) {
+    return bytes <= kMinClass
+               ? 0
+               : static_cast<size_t>(std::bit_width((bytes - 1) / kMinClass));
+  }
+};
+
+// A BumpArena per thread, so that threads updating different parts of a
+// concurrent table allocate without contending. A thread always uses its own
+// shard, including to free blocks another thread allocated; that is sound
+// because the arena owns every shard's chunks until it is destroyed. Each
+// shard keeps a lock for the rare threads that share one.
+class ShardedArena {
+ public:
+  void* Allocate(size_t bytes, size_t align) {
+    auto& shard = shards_[ThreadIndex() % kShards].value;
+    std::scoped_lock<std::mutex> lock(shard.mutex);
+    return shard.arena.Allocate(bytes, align);
+  }
+
+  void Deallocate(void* ptr, size_t bytes, size_t align) {
+    auto& shard = shards_[ThreadIndex() % kShards].value;
+    std::scoped_lock<std::mutex> lock(shard.mutex);
+    shard.arena.Deallocate(ptr, bytes, align);
+  }
+
+ private:
+  static constexpr size_t kShards = 64;
+
+  struct Shard {
+    std::mutex mutex;
+    BumpArena arena;
+  };
+
+  std::array<CacheLinePadded<Shard>, kShards> shards_;
+};
+
+// A standard allocator drawing from an |Arena|, either BumpArena or
+// ShardedArena, that it does not own. Containers using it must not outlive
+// the arena.
+template <typename T, typename Arena>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+  // containers moved or swapped between tables take their arena with them
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  explicit ArenaAllocator(Arena* arena) noexcept : arena_(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U, Arena>& other) noexcept
+      : arena_(other.arena_) {}
+
+  T* allocate(size_t n) {
+    if (n > SIZE_MAX / sizeof(T)) throw std::bad_array_new_length();
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) noexcept {
+    arena_->Deallocate(ptr, n * sizeof(T), alignof(T));
+  }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U, Arena>& other) const noexcept {
+    return arena_ == other.arena_;
+  }
+
+ private:
+  template <typename U, typename A>
+  friend class ArenaAllocator;
+
+  Arena* arena_;
+};
+
+// Whether containers using |Alloc| may allocate from several threads at once.
+// True of std::allocator and of arenas other than BumpArena.
+template <typename Alloc>
+inline constexpr bool kThreadSafeAllocator = true;
+
+template <typename T>
+inline constexpr bool kThreadSafeAllocator<ArenaAllocator<T, BumpArena>> =
+    false;
+
+// Owns whatever backs the allocator |Alloc| for one generation of a table's
+// buckets. A table makes a new one for each rehash and drops the old one once
+// every element has moved out, which for an ArenaAllocator releases all of the
+// old buckets' memory in one step. Stateless allocators need nothing.
+template <typename Alloc>
+class TableArena {
+ public:
+  [[nodiscard]] Alloc allocator() const { return Alloc(); }
+};
+
+template <typename T, typename Arena>
+class TableArena<ArenaAllocator<T, Arena>> {
+ public:
+  TableArena() : arena_(std::make_unique<Arena>()) {}
+
+  [[nodiscard]] ArenaAllocator<T, Arena> allocator() const {
+    return ArenaAllocator<T, Arena>(arena_.get());
+  }
+
+ private:
+  std::unique_ptr<Arena> arena_;
+};
+
+// The array of buckets |Bucket| of a chained table, allocated like them.
+template <typename Bucket>
+using BucketArray = std::vector<
+    Bucket, typename std::allocator_traits<typename Bucket::allocator_type>::
+                template rebind_alloc<Bucket>>;
+
+// Returns |n| empty buckets that, like the array holding them, take their
+// storage from |alloc|.
+template <typename Bucket>
+BucketArray<Bucket> MakeBuckets(size_t n,
+                                const typename Bucket::allocator_type& alloc) {
+  return BucketArray<Bucket>(
+      n, Bucket(alloc), typename BucketArray<Bucket>::allocator_type(alloc));
+}
+
+#endif  // UTIL_ARENA_H
@@ -0,0 +1,74 @@
+#ifndef UTIL_BATCH_H
+#define UTIL_BATCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "src/util/hash_policy.h"
+#include "src/util/prefetch.h"
+
+// One element of a batch operation, with its hash computed up front.
+struct BatchEntry {
+  size_t hash;
+  size_t stripe;  // the lock guarding the element
+  size_t index;   // position of the element in the batch
+};
+
+// Sorts |entries| by stripe, with |stripes| locks in total indexed as |Policy|
+// indexes buckets. Within a stripe the entries keep their batch order, so
+// repeated elements are applied in the order given.
+template <typename Policy = DefaultBucketPolicy>
+void GroupByStripe(std::vector<BatchEntry>& entries, size_t stripes) {
+  for (auto& entry : entries) {
+    entry.stripe = Policy::Index(entry.hash, stripes);
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const BatchEntry& a, const BatchEntry& b) {
+              return a.stripe != b.stripe ? a.stripe < b.stripe
+                                          : a.index < b.index;
+            });
+}
+
+// Hashes every element of |elems| once and returns the entries grouped by
+// stripe, so that each stripe's lock can be taken once for all of its
+// elements.
+template <typename Policy = DefaultBucketPolicy, typename T, typename Hasher>
+std::vector<BatchEntry> GroupByStripe(std::span<const T> elems,
+                                      const Hasher& hasher, size_t stripes) {
+  std::vector<BatchEntry> entries(elems.size());
+  for (size_t i = 0; i < elems.size(); i++) {
+    entries[i] = {hasher(elems[i]), 0, i};
+  }
+  GroupByStripe<Policy>(entries, stripes);
+  return entries;
+}
+
+// Calls |op(i, hash)| for every element |elems[i]| in order, where |hash| is
+// table.Hash(elems[i]). All hashes are computed up front, and the element
+// kPrefetchDistance ahead is prefetched before each call: in two steps, as by
+// PrefetchAhead(), for tables whose buckets point to their elements and so
+// offer PrefetchElements().
+template <typename Table, typename T, typename Op>
+void ForEachPrefetched(const Table& table, std::span<const T> elems, Op op) {
+  std::vector<size_t> hashes(elems.size());
+  for (size_t i = 0; i < elems.size(); i++) {
+    hashes[i] = table.Hash(elems[i]);
+  }
+  for (size_t i = 0; i < elems.size(); i++) {
+    if constexpr (requires { table.PrefetchElements(hashes[i]); }) {
+      if (i + 2 * kPrefetchDistance < elems.size()) {
+        table.Prefetch(hashes[i + 2 * kPrefetchDistance]);
+      }
+      if (i + kPrefetchDistance < elems.size()) {
+        table.PrefetchElements(hashes[i + kPrefetchDistance]);
+      }
+    } else if (i + kPrefetchDistance < elems.size()) {
+      table.Prefetch(hashes[i + kPrefetchDistance]);
+    }
+    op(i, hashes[i]);
+  }
+}
+
+#endif  // UTIL_BATCH_H
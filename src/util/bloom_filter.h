@@ -0,0 +1,131 @@
+#ifndef UTIL_BLOOM_FILTER_H
+#define UTIL_BLOOM_FILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "src/util/cache_line.h"
+
+// A blocked counting Bloom filter (Putze et al., "Cache-, Hash- and
+// Space-Efficient Bloom Filters"; Fan et al., "Summary Cache"), safe for any
+// number of threads at once without locks. Each hash selects one block of a
+// cache line, and kHashes 4-bit counters within it, so a query reads a single
+// line. Insert() increments the counters and Erase() decrements them, so
+// elements can be taken out again; a counter that reaches its maximum sticks
+// there, which only ever makes the filter answer "maybe" where it need not.
+//
+// MayContain() is never false for a hash that was inserted and not erased
+// since. With kCountersPerElement counters for each of Capacity() elements,
+// about 3% of other hashes are let through, rising as more are inserted.
+//
+// Hashes must be well mixed, as by Mix64(): the block is taken from the high
+// bits and the counters from the low ones.
+class CountingBloomFilter {
+ public:
+  static constexpr size_t kCountersPerElement = 8;
+
+  explicit CountingBloomFilter(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1)),
+        block_count_((capacity_ * kCountersPerElement + kCountersPerBlock - 1) /
+                     kCountersPerBlock),
+        blocks_(new Block[block_count_]) {}
+
+  // The number of elements the filter was sized for.
+  [[nodiscard]] size_t Capacity() const { return capacity_; }
+
+  void Insert(uint64_t hash) {
+    Block& block = BlockOf_(hash);
+    for (size_t i = 0; i < kHashes; i++) {
+      Update_(block, hash, i, +1);
+    }
+  }
+
+  // Takes out one insertion of |hash|, which must have been inserted.
+  void Erase(uint64_t hash) {
+    Block& block = BlockOf_(hash);
+    for (size_t i = 0; i < kHashes; i++) {
+      Update_(block, hash, i, -1);
+    }
+  }
+
+  // Returns false only if |hash| is certainly not in the filter.
+  [[nodiscard]] bool MayContain(uint64_t hash) const {
+    const Block& block = BlockOf_(hash);
+    for (size_t i = 0; i < kHashes; i++) {
+      auto [word, shift] = Counter_(hash, i);
+      uint64_t bits = block.words[word].load(std::memory_order_relaxed);
+      if (((bits >> shift) & kCounterMax) == 0) return false;
+    }
+    return true;
+  }
+
+ private:
+  static constexpr size_t kCounterBits = 4;
+  static constexpr uint64_t kCounterMax = (uint64_t{1} << kCounterBits) - 1;
+  static constexpr size_t kWordsPerBlock = kCacheLineSize / sizeof(uint64_t);
+  static constexpr size_t kCountersPerWord = 64 / kCounterBits;
+  static constexpr size_t kCountersPerBlock = kWordsPerBlock * kCountersPerWord;
+  // Each hash function picks a counter in its own pair of words, so an
+  // element's counters are distinct and one query touches kHashes words.
+  static constexpr size_t kHashes = kWordsPerBlock / 2;
+
+  struct alignas(kCacheLineSize) Block {
+    std::atomic<uint64_t> words[kWordsPerBlock]{};
+  };
+
+  size_t capacity_;
+  size_t block_count_;
+  std::unique_ptr<Block[]> blocks_;
+
+  /**
+   * Returns the block for |hash|, from its high half by multiplying rather
+   * than dividing, so that any block count works.
+   */
+  const Block& BlockOf_(uint64_t hash) const {
+    return blocks_[((hash >> 32) * block_count_) >> 32];
+  }
+
+  Block& BlockOf_(uint64_t hash) {
+    return blocks_[((hash >> 32) * block_count_) >> 32];
+  }
+
+  struct CounterPosition {
+    size_t word;
+    size_t shift;
+  };
+
+  /**
+   * Returns where the counter of hash function |i| lies: in word 2i or 2i+1,
+   * chosen by one bit of |hash|, at a position chosen by the next four.
+   */
+  static CounterPosition Counter_(uint64_t hash, size_t i) {
+    uint64_t bits = hash >> (i * 5);
+    return {2 * i + (bits & 1),
+            static_cast<size_t>((bits >> 1) % kCountersPerWord) * kCounterBits};
+  }
+
+  /**
+   * Adds |delta|, +1 or -1, to the counter of hash function |i|, unless that
+   * counter is stuck at its maximum or would go below zero.
+   */
+  static void Update_(Block& block, uint64_t hash, size_t i, int delta) {
+    auto [word, shift] = Counter_(hash, i);
+    auto& bits = block.words[word];
+    uint64_t old = bits.load(std::memory_order_relaxed);
+    while (true) {
+      uint64_t count = (old >> shift) & kCounterMax;
+      if (count == kCounterMax || (delta < 0 && count == 0)) return;
+      uint64_t updated = delta > 0 ? old + (uint64_t{1} << shift)
+                                   : old - (uint64_t{1} << shift);
+      if (bits.compare_exchange_weak(old, updated,
+                                     std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+};
+
+#endif  // UTIL_BLOOM_FILTER_H
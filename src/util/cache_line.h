@@ -0,0 +1,16 @@
+#ifndef UTIL_CACHE_LINE_H
+#define UTIL_CACHE_LINE_H
+
+#include <cstddef>
+
+// Size of a cache line on the platforms we target (x86-64 and AArch64).
+inline constexpr size_t kCacheLineSize = 64;
+
+// Wraps |T| so that each instance occupies its own cache line. Placing these in
+// an array stops neighbouring elements from false-sharing a line.
+template <typename T>
+struct alignas(kCacheLineSize) CacheLinePadded {
+  T value;
+};
+
+#endif  // UTIL_CACHE_LINE_H
@@ -0,0 +1,125 @@
+#ifndef UTIL_COOPERATIVE_REHASH_H
+#define UTIL_COOPERATIVE_REHASH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "src/util/set_stats.h"
+
+// Splits a rehash into chunks of old buckets, which the resizing thread and
+// any threads that would otherwise block on it claim in turn, in the manner of
+// the transfer in Java's ConcurrentHashMap. Growing by a whole factor maps each
+// old bucket to its own set of new buckets, so chunks migrate independently.
+//
+// Run() must only be called by one thread at a time, the one holding whatever
+// excludes other users of the table; Help() and Acquire() may be called by any
+// thread that holds no lock the resizing thread could be waiting for.
+class CooperativeRehash {
+ public:
+  // Calls |migrate(begin, end)| over disjoint ranges covering [0, buckets),
+  // from this thread and from threads in Help(). Returns once every range is
+  // done and no helper still refers to |migrate|. Small tables are migrated
+  // by this thread alone, since coordinating would cost more than it saves.
+  template <typename Migrate>
+  void Run(size_t buckets, Migrate migrate) {
+    if (buckets < kMinParallelBuckets) {
+      migrate(size_t{0}, buckets);
+      return;
+    }
+
+    // 1) describe the job, then publish it
+    migrate_ = [](void* context, size_t begin, size_t end) {
+      (*static_cast<Migrate*>(context))(begin, end);
+    };
+    context_ = &migrate;
+    buckets_ = buckets;
+    next_.store(0, std::memory_order_relaxed);
+    done_.store(0, std::memory_order_relaxed);
+    active_.store(true);
+
+    // 2) take chunks alongside any helpers, then wait for theirs to finish
+    Work_();
+    while (done_.load(std::memory_order_acquire) != buckets) {
+      std::this_thread::yield();
+    }
+
+    // 3) retract the job; a helper that saw it published has registered in
+    //    |helpers_| first, so once that drains none can still be using it
+    active_.store(false);
+    while (helpers_.load() != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  // Migrates chunks of the rehash in progress, if there is one. A single
+  // relaxed load when there is not.
+  void Help() {
+    if (!active_.load(std::memory_order_relaxed)) return;
+
+    helpers_.fetch_add(1);
+    if (active_.load()) {
+      size_t migrated = Work_();
+      if constexpr (kCollectStats) {
+        helped_buckets_.fetch_add(migrated, std::memory_order_relaxed);
+      }
+    }
+    helpers_.fetch_sub(1);
+  }
+
+  // Takes |lock|, a deferred std::unique_lock or std::shared_lock on a mutex
+  // that the resizing thread holds while it calls Run(). While a rehash is in
+  // progress this retries try_lock(), helping between attempts; otherwise it
+  // blocks in lock(), so that the mutex keeps its own queueing, fairness and
+  // sleeping. A thread that blocked before a rehash began sleeps through it.
+  template <typename Lock>
+  void Acquire(Lock& lock) {
+    while (active_.load(std::memory_order_relaxed)) {
+      if (lock.try_lock()) return;
+      Help();
+      std::this_thread::yield();
+    }
+    lock.lock();
+  }
+
+  // The buckets that threads in Help() have migrated, counted only when built
+  // with HASH_SET_STATS.
+  [[nodiscard]] uint64_t HelpedBuckets() const {
+    return helped_buckets_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr size_t kChunkBuckets = 1024;
+  static constexpr size_t kMinParallelBuckets = 4 * kChunkBuckets;
+
+  // the job, written by Run() before |active_| is set and read after it
+  void (*migrate_)(void*, size_t, size_t) = nullptr;
+  void* context_ = nullptr;
+  size_t buckets_ = 0;
+
+  std::atomic<bool> active_{false};
+  std::atomic<size_t> next_{0};     // start of the next unclaimed chunk
+  std::atomic<size_t> done_{0};     // number of buckets migrated so far
+  std::atomic<size_t> helpers_{0};  // threads inside Help()
+  std::atomic<uint64_t> helped_buckets_{0};
+
+  /**
+   * Migrates chunks until none is left unclaimed, and returns the number of
+   * buckets this thread migrated.
+   */
+  size_t Work_() {
+    size_t migrated = 0;
+    while (true) {
+      size_t begin = next_.fetch_add(kChunkBuckets, std::memory_order_relaxed);
+      if (begin >= buckets_) return migrated;
+      size_t end = std::min(begin + kChunkBuckets, buckets_);
+      migrate_(context_, begin, end);
+      done_.fetch_add(end - begin, std::memory_order_release);
+      migrated += end - begin;
+    }
+  }
+};
+
+#endif  // UTIL_COOPERATIVE_REHASH_H
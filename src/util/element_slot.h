@@ -0,0 +1,89 @@
+#ifndef UTIL_ELEMENT_SLOT_H
+#define UTIL_ELEMENT_SLOT_H
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// An argument that a table adds by copying or moving: a T, however qualified.
+template <typename U, typename T>
+concept ElementOf = std::same_as<std::remove_cvref_t<U>, T>;
+
+// Whether tables store each element's hash beside it. The cached hash costs a
+// word per element, but a rehash then moves elements without hashing them
+// again, and a search compares hashes before it compares elements; both pay
+// off when hashing or comparing is dear, as for strings. On for every type but
+// scalars, whose hashes are cheap; specialise it to choose otherwise.
+template <typename T>
+inline constexpr bool kCacheHash = !std::is_scalar_v<T>;
+
+// How a table stores an element: as a bare T, or with its hash if |kCache|.
+// Tables handle slots only through these members, so that the same code serves
+// both layouts; without the cache they compile to what using T directly would.
+// The cached hash is whatever the table computed for the element, so each
+// table must always hash with the same function.
+template <typename T, bool kCache = kCacheHash<T>>
+struct SlotTraits {
+  using Slot = T;
+
+  template <typename U>
+  static Slot Make(U&& elem, size_t /*hash*/) {
+    return Slot(std::forward<U>(elem));
+  }
+
+  static const T& Elem(const Slot& slot) { return slot; }
+
+  // Returns the hash of |slot|, as |hash_of(elem)| computes it.
+  template <typename HashOf>
+  static size_t Hash(const Slot& slot, const HashOf& hash_of) {
+    return hash_of(slot);
+  }
+
+  // Returns true if |slot| holds |key|, whose hash is |hash|.
+  template <typename Key>
+  static bool Matches(const Slot& slot, const Key& key, size_t /*hash*/) {
+    return slot == key;
+  }
+
+  // Returns the first slot of [begin, end) that holds |key|, or |end|.
+  template <typename It, typename Key>
+  static It Find(It begin, It end, const Key& key, size_t /*hash*/) {
+    return std::find(begin, end, key);
+  }
+};
+
+template <typename T>
+struct SlotTraits<T, true> {
+  struct Slot {
+    T elem;
+    size_t hash;
+  };
+
+  template <typename U>
+  static Slot Make(U&& elem, size_t hash) {
+    return Slot{T(std::forward<U>(elem)), hash};
+  }
+
+  static const T& Elem(const Slot& slot) { return slot.elem; }
+
+  template <typename HashOf>
+  static size_t Hash(const Slot& slot, const HashOf& /*hash_of*/) {
+    return slot.hash;
+  }
+
+  template <typename Key>
+  static bool Matches(const Slot& slot, const Key& key, size_t hash) {
+    return slot.hash == hash && slot.elem == key;
+  }
+
+  template <typename It, typename Key>
+  static It Find(It begin, It end, const Key& key, size_t hash) {
+    return std::find_if(begin, end, [&](const Slot& slot) {
+      return Matches(slot, key, hash);
+    });
+  }
+};
+
+#endif  // UTIL_ELEMENT_SLOT_H
@@ -0,0 +1,151 @@
+#ifndef UTIL_HASH_POLICY_H
+#define UTIL_HASH_POLICY_H
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+// Returns |hash| with every input bit affecting every output bit (the 64-bit
+// finaliser of MurmurHash3).
+constexpr uint64_t Mix64(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// A hasher that mixes the result of |Hasher|. std::hash of an integer is
+// usually the identity, so without mixing clustered keys share low bits and
+// therefore buckets once the bucket index is taken with a mask.
+template <typename T, typename Hasher = std::hash<T>>
+struct MixHash {
+  [[nodiscard]] size_t operator()(const T& elem) const {
+    return static_cast<size_t>(Mix64(static_cast<uint64_t>(hasher(elem))));
+  }
+
+  [[no_unique_address]] Hasher hasher;
+};
+
+// True if a table or set of |T| hashed by |Hasher| can look up a |Key| without
+// building a T from it, as std::unordered_set does with transparent hashers:
+// |Hasher| declares is_transparent, hashes a Key as it would the equal T, and
+// T and Key compare with ==.
+template <typename Key, typename T, typename Hasher>
+concept TransparentKey =
+    !std::same_as<Key, T> && requires { typename Hasher::is_transparent; } &&
+    std::invocable<const Hasher&, const Key&> &&
+    requires(const T& elem, const Key& key) {
+      { elem == key } -> std::convertible_to<bool>;
+    };
+
+// The keys that a table of |T| hashed by |Hasher| looks up: T itself, or any
+// TransparentKey.
+template <typename Key, typename T, typename Hasher>
+concept LookupKey = std::same_as<Key, T> || TransparentKey<Key, T, Hasher>;
+
+// A transparent hasher for sets of std::string, taking anything that converts
+// to std::string_view, so that looking up a std::string_view or a literal
+// builds no std::string. Hashes as std::hash<std::string> does.
+struct StringHash {
+  using is_transparent = void;
+
+  [[nodiscard]] size_t operator()(std::string_view text) const {
+    return std::hash<std::string_view>{}(text);
+  }
+};
+
+// How a chained table maps hashes to buckets and when and by how much it grows.
+// Every member is a compile-time constant or a constexpr function, so a set
+// instantiated with a policy has no runtime branch on it.
+//   kMaxLoad      - the table grows once the average bucket holds more than
+//                   this many elements;
+//   kGrowthFactor - the bucket count is multiplied by this on each growth;
+//   kPowerOfTwo   - bucket counts are rounded up to a power of two and indices
+//                   are taken with a mask rather than a division. Pair this
+//                   with a mixing hasher such as MixHash;
+//   kShrinkRatio  - the table shrinks by kGrowthFactor once the average load
+//                   falls below kMaxLoad / kShrinkRatio, or never if 0. It
+//                   must exceed kGrowthFactor, so that a table that has just
+//                   shrunk is well clear of growing again.
+// A bucket count always stays a multiple of the initial one, which the striped
+// set relies on for every bucket to map to exactly one stripe. Tables never
+// shrink below the bucket count they were constructed with.
+template <size_t kMaxLoad = 4, size_t kGrowthFactor = 2,
+          bool kPowerOfTwo = false, size_t kShrinkRatio = 4>
+struct BucketPolicy {
+  static_assert(kMaxLoad > 0, "a table must hold some elements per bucket");
+  static_assert(kGrowthFactor >= 2, "growing must add buckets");
+  static_assert(!kPowerOfTwo || std::has_single_bit(kGrowthFactor),
+                "masking needs the bucket count to stay a power of two");
+  static_assert(kShrinkRatio == 0 || kShrinkRatio > kGrowthFactor,
+                "shrinking must leave room before the next growth");
+
+  static constexpr size_t kMaxLoadFactor = kMaxLoad;
+  static constexpr size_t kGrowth = kGrowthFactor;
+  static constexpr bool kMasked = kPowerOfTwo;
+
+  // Returns the bucket count to use when |requested| buckets are asked for.
+  static constexpr size_t Buckets(size_t requested) {
+    return kPowerOfTwo ? std::bit_ceil(requested) : requested;
+  }
+
+  // Returns the index of the bucket for |hash| among |buckets| buckets, which
+  // must have come from Buckets() or Grow().
+  static constexpr size_t Index(size_t hash, size_t buckets) {
+    return kPowerOfTwo ? hash & (buckets - 1) : hash % buckets;
+  }
+
+  static constexpr bool NeedsResize(size_t size, size_t buckets) {
+    return size / buckets > kMaxLoad;
+  }
+
+  static constexpr size_t Grow(size_t buckets) {
+    return buckets * kGrowthFactor;
+  }
+
+  // Returns true if a table of |buckets| holding |size| elements should
+  // shrink, given that it may not go below |min_buckets|.
+  static constexpr bool NeedsShrink(size_t size, size_t buckets,
+                                    size_t min_buckets) {
+    return kShrinkRatio != 0 && buckets > min_buckets &&
+           size * kShrinkRatio < buckets * kMaxLoad;
+  }
+
+  static constexpr size_t Shrink(size_t buckets) {
+    return buckets / kGrowthFactor;
+  }
+
+  // Returns the smallest bucket count reachable from |buckets| by growing
+  // that holds |size| elements without needing to resize.
+  static constexpr size_t Reserved(size_t size, size_t buckets) {
+    while (NeedsResize(size, buckets) && buckets <= SIZE_MAX / kGrowthFactor) {
+      buckets = Grow(buckets);
+    }
+    return buckets;
+  }
+
+  // Returns the smallest bucket count reachable from |buckets| by shrinking,
+  // down to |min_buckets|, that holds |size| elements without needing to
+  // resize.
+  static constexpr size_t Fitted(size_t size, size_t buckets,
+                                 size_t min_buckets) {
+    while (buckets > min_buckets && !NeedsResize(size, Shrink(buckets))) {
+      buckets = Shrink(buckets);
+    }
+    return buckets;
+  }
+};
+
+// The original growth: past four elements per bucket, doubling, with indices
+// taken modulo the bucket count. Shrinks below one element per bucket.
+using DefaultBucketPolicy = BucketPolicy<>;
+
+// Power-of-two bucket counts with masked indices. Use with MixHash.
+using Pow2BucketPolicy = BucketPolicy<4, 2, true>;
+
+#endif  // UTIL_HASH_POLICY_H
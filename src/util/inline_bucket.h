@@ -0,0 +1,219 @@
+#ifndef UTIL_INLINE_BUCKET_H
+#define UTIL_INLINE_BUCKET_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "src/util/cache_line.h"
+
+// How many elements of |T| an InlineBucket keeps inside its own cache line,
+// beside its sizes and, unless it is stateless, its allocator.
+template <typename T, typename Allocator>
+inline constexpr size_t kInlineCapacity = [] {
+  size_t align = std::max(alignof(T), alignof(T*));
+  size_t header = 2 * sizeof(uint32_t) +
+                  (std::is_empty_v<Allocator> ? 0 : sizeof(Allocator));
+  header = (header + align - 1) / align * align;
+  return header >= kCacheLineSize ? 0 : (kCacheLineSize - header) / sizeof(T);
+}();
+
+// A bucket of a chained table that keeps up to kInlineCapacity elements within
+// itself, in one cache line, and moves them to storage from |Allocator| only
+// once it outgrows that. At the policies' loads of a few elements per bucket,
+// most buckets then never allocate, and a search reads the one line holding
+// the bucket instead of a vector header and then its heap block. Each bucket
+// is aligned to its own line, so threads filling neighbouring buckets, as a
+// parallel rehash does, do not false-share.
+//
+// Provides the subset of std::vector that the tables use, with the same
+// meaning; iterators are pointers and are invalidated as a vector's are.
+// Allocators are taken along on moves and swaps, as ArenaAllocator requires.
+template <typename T, typename Allocator = std::allocator<T>>
+class alignas(kCacheLineSize) InlineBucket {
+  static_assert(kInlineCapacity<T, Allocator> > 0,
+                "an element this large does not fit inline; use std::vector");
+  static_assert(std::is_nothrow_move_constructible_v<T>,
+                "elements move between inline and heap storage");
+
+  using Traits = std::allocator_traits<Allocator>;
+
+ public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  static constexpr size_t kInline = kInlineCapacity<T, Allocator>;
+
+  explicit InlineBucket(const Allocator& alloc) : alloc_(alloc) {
+    static_assert(sizeof(InlineBucket) == kCacheLineSize);
+  }
+
+  InlineBucket(const InlineBucket& other) : alloc_(other.alloc_) {
+    Reserve_(other.size_);
+    std::uninitialized_copy(other.begin(), other.end(), data());
+    size_ = other.size_;
+  }
+
+  InlineBucket(InlineBucket&& other) noexcept : alloc_(other.alloc_) {
+    Take_(other);
+  }
+
+  InlineBucket& operator=(const InlineBucket&) = delete;
+
+  InlineBucket& operator=(InlineBucket&& other) noexcept {
+    if (this != &other) {
+      Reset_();
+      alloc_ = other.alloc_;
+      Take_(other);
+    }
+    return *this;
+  }
+
+  ~InlineBucket() { Reset_(); }
+
+  void swap(InlineBucket& other) noexcept {
+    InlineBucket tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  void push_back(const T& elem) { EmplaceBack_(elem); }
+  void push_back(T&& elem) { EmplaceBack_(std::move(elem)); }
+
+  // Removes the element at |pos|, keeping the order of the others.
+  iterator erase(const_iterator pos) {
+    T* i = begin() + (pos - begin());
+    std::move(i + 1, end(), i);
+    std::destroy_at(end() - 1);
+    size_--;
+    return i;
+  }
+
+  // Moves the elements back inline if they fit there, and otherwise into heap
+  // storage of exactly their number.
+  void shrink_to_fit() {
+    if (IsInline_() || size_ == capacity_) return;
+    Relocate_(std::max<size_t>(size_, kInline));
+  }
+
+  [[nodiscard]] T* data() {
+    return IsInline_() ? std::launder(reinterpret_cast<T*>(inline_)) : heap_;
+  }
+
+  [[nodiscard]] const T* data() const {
+    return IsInline_() ? std::launder(reinterpret_cast<const T*>(inline_))
+                       : heap_;
+  }
+
+  [[nodiscard]] iterator begin() { return data(); }
+  [[nodiscard]] iterator end() { return data() + size_; }
+  [[nodiscard]] const_iterator begin() const { return data(); }
+  [[nodiscard]] const_iterator end() const { return data() + size_; }
+
+  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+  [[nodiscard]] size_t capacity() const { return capacity_; }
+
+  [[nodiscard]] allocator_type get_allocator() const { return alloc_; }
+
+ private:
+  uint32_t size_ = 0;
+  uint32_t capacity_ = kInline;  // more than kInline once on the heap
+  [[no_unique_address]] Allocator alloc_;
+  union {
+    T* heap_;
+    alignas(T) std::byte inline_[kInline * sizeof(T)];
+  };
+
+  [[nodiscard]] bool IsInline_() const { return capacity_ == kInline; }
+
+  template <typename U>
+  void EmplaceBack_(U&& elem) {
+    if (size_ == capacity_) {
+      Relocate_(2 * size_t{capacity_}, std::forward<U>(elem));
+      return;
+    }
+    std::construct_at(end(), std::forward<U>(elem));
+    size_++;
+  }
+
+  void Reserve_(size_t n) {
+    if (n > capacity_) Relocate_(n);
+  }
+
+  /**
+   * Moves the elements to storage for |capacity| of them, inline if that is
+   * kInline, appending |extra| if given.
+   */
+  template <typename... Extra>
+  void Relocate_(size_t capacity, Extra&&... extra) {
+    assert(capacity >= size_ + sizeof...(Extra) && capacity <= UINT32_MAX);
+    T* old = data();
+    bool was_inline = IsInline_();
+    size_t old_capacity = capacity_;
+
+    // the extra element may refer into the old storage, so construct it
+    // before moving the others
+    T* fresh = capacity == kInline
+                   ? std::launder(reinterpret_cast<T*>(inline_))
+                   : Traits::allocate(alloc_, capacity);
+    if constexpr (sizeof...(Extra) > 0) {
+      std::construct_at(fresh + size_, std::forward<Extra>(extra)...);
+    }
+    if (fresh != old) {
+      std::uninitialized_move(old, old + size_, fresh);
+      std::destroy_n(old, size_);
+    }
+    if (!was_inline) Traits::deallocate(alloc_, old, old_capacity);
+
+    if (capacity != kInline) heap_ = fresh;
+    capacity_ = static_cast<uint32_t>(capacity);
+    size_ += sizeof...(Extra);
+  }
+
+  /**
+   * Takes the elements of |other| into this empty bucket, which already holds
+   * a copy of its allocator, leaving |other| empty.
+   */
+  void Take_(InlineBucket& other) noexcept {
+    if (other.IsInline_()) {
+      std::uninitialized_move(other.begin(), other.end(), data());
+      std::destroy_n(other.data(), other.size_);
+    } else {
+      heap_ = other.heap_;
+      capacity_ = other.capacity_;
+      other.capacity_ = kInline;
+    }
+    size_ = other.size_;
+    other.size_ = 0;
+  }
+
+  /**
+   * Destroys every element and releases any heap storage, leaving the bucket
+   * empty and inline.
+   */
+  void Reset_() {
+    std::destroy_n(data(), size_);
+    if (!IsInline_()) Traits::deallocate(alloc_, heap_, capacity_);
+    size_ = 0;
+    capacity_ = kInline;
+  }
+};
+
+// The bucket a chained table of |T| uses: an InlineBucket if a bucket at the
+// policy's maximum load of |kMaxLoad| elements fits inline, and otherwise a
+// std::vector, which is then the smaller of the two.
+template <typename T, typename Allocator, size_t kMaxLoad>
+using SmallBucket =
+    std::conditional_t<(kInlineCapacity<T, Allocator> >= kMaxLoad),
+                       InlineBucket<T, Allocator>, std::vector<T, Allocator>>;
+
+#endif  // UTIL_INLINE_BUCKET_H
@@ -0,0 +1,184 @@
+#ifndef UTIL_LOCKS_H
+#define UTIL_LOCKS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Locks for the short critical sections of the sets, to pass as their |Mutex|
+// parameter in place of std::mutex, which sleeps in the kernel as soon as it
+// finds the lock taken. Each meets the Lockable requirements, so it also works
+// with std::unique_lock and StatsMutex. A holder may be descheduled when
+// there are more threads than cores, so none of them spins without bound:
+// past a limit they yield the CPU, or sleep, instead.
+//
+//   TtasLock       - spins reading the lock until it looks free and only then
+//                    tries to take it, backing off exponentially after each
+//                    failure; the cheapest when held briefly.
+//   AdaptiveMutex  - spins for about as long as recent acquisitions needed to,
+//                    then sleeps until woken, like glibc's adaptive mutexes.
+//   TicketLock     - grants the lock in arrival order, so no thread starves;
+//                    waiters back off in proportion to their place in line.
+//                    With more threads than cores every handoff waits for
+//                    the next in line to be scheduled, so it is for pinned
+//                    threads only.
+//
+// MCS and other queue locks are not offered: they need a queue node for each
+// lock a thread holds, and the striped set holds every stripe at once.
+
+// Tells the CPU that the thread is spinning, which frees the core's resources
+// for a sibling hyperthread and avoids a memory-order flush on exit.
+inline void CpuRelax() {
+#if defined(__SSE2__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Exponential backoff for spinning waiters: each Pause() spins twice as long
+// as the one before, up to a limit past which it yields the CPU instead.
+class Backoff {
+ public:
+  void Pause() {
+    if (spins_ > kMaxSpins) {
+      std::this_thread::yield();
+      return;
+    }
+    for (uint32_t i = 0; i < spins_; i++) CpuRelax();
+    spins_ *= 2;
+  }
+
+ private:
+  static constexpr uint32_t kMaxSpins = 1024;
+
+  uint32_t spins_ = 1;
+};
+
+class TtasLock {
+ public:
+  void lock() {
+    while (locked_.exchange(true, std::memory_order_acquire)) {
+      // wait on the cached copy, so waiters take no exclusive line until it
+      // has been released
+      Backoff backoff;
+      do {
+        backoff.Pause();
+      } while (locked_.load(std::memory_order_relaxed));
+    }
+  }
+
+  bool try_lock() {
+    return !locked_.load(std::memory_order_relaxed) &&
+           !locked_.exchange(true, std::memory_order_acquire);
+  }
+
+  void unlock() { locked_.store(false, std::memory_order_release); }
+
+ private:
+  std::atomic<bool> locked_{false};
+};
+
+class AdaptiveMutex {
+ public:
+  void lock() {
+    if (try_lock()) return;
+
+    // spin for up to twice the recent average before sleeping
+    uint32_t limit = std::min(2 * spins_.load(std::memory_order_relaxed) + 16,
+                              kMaxSpins);
+    for (uint32_t spin = 1; spin <= limit; spin++) {
+      CpuRelax();
+      if (state_.load(std::memory_order_relaxed) == kUnlocked && try_lock()) {
+        Learn_(spin);
+        return;
+      }
+    }
+    Learn_(limit);
+
+    // mark the lock contended, so that its holder wakes us, and sleep until
+    // it is released
+    while (state_.exchange(kContended, std::memory_order_acquire) !=
+           kUnlocked) {
+      state_.wait(kContended, std::memory_order_relaxed);
+    }
+  }
+
+  bool try_lock() {
+    uint32_t expected = kUnlocked;
+    return state_.compare_exchange_strong(expected, kLocked,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
+
+  void unlock() {
+    if (state_.exchange(kUnlocked, std::memory_order_release) == kContended) {
+      state_.notify_one();
+    }
+  }
+
+ private:
+  static constexpr uint32_t kMaxSpins = 1024;
+
+  // kContended means that threads may be sleeping on the lock (Drepper,
+  // "Futexes Are Tricky"), so that an uncontended unlock makes no system call
+  enum State : uint32_t { kUnlocked, kLocked, kContended };
+
+  std::atomic<uint32_t> state_{kUnlocked};
+  // a moving average of the spins that acquisitions took, written racily
+  std::atomic<uint32_t> spins_{0};
+
+  void Learn_(uint32_t spins) {
+    uint32_t average = spins_.load(std::memory_order_relaxed);
+    spins_.store(average - average / 8 + spins / 8,
+                 std::memory_order_relaxed);
+  }
+};
+
+class TicketLock {
+ public:
+  void lock() {
+    uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+    uint32_t last = ticket;
+    while (true) {
+      uint32_t serving = serving_.load(std::memory_order_acquire);
+      if (serving == ticket) return;
+      if (serving == last) {
+        // no handoff for a whole round: the holder, or the thread next in
+        // line, is probably not running
+        std::this_thread::yield();
+      } else {
+        for (uint32_t i = 0; i < (ticket - serving) * kSpinsPerWaiter; i++) {
+          CpuRelax();
+        }
+      }
+      last = serving;
+    }
+  }
+
+  bool try_lock() {
+    uint32_t serving = serving_.load(std::memory_order_acquire);
+    return next_.compare_exchange_strong(serving, serving + 1,
+                                         std::memory_order_relaxed);
+  }
+
+  void unlock() {
+    // only the holder writes |serving_|
+    serving_.store(serving_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+  }
+
+ private:
+  // roughly the length of a critical section, in CpuRelax() calls
+  static constexpr uint32_t kSpinsPerWaiter = 32;
+
+  std::atomic<uint32_t> next_{0};     // the ticket handed to the next arrival
+  std::atomic<uint32_t> serving_{0};  // the ticket that holds the lock
+};
+
+#endif  // UTIL_LOCKS_H
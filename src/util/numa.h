@@ -0,0 +1,125 @@
+#ifndef UTIL_NUMA_H
+#define UTIL_NUMA_H
+
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// The NUMA nodes of the machine, each with the CPUs on it that this process
+// may run on, as Linux lists them under /sys/devices/system/node. Nodes
+// without such CPUs, such as memory-only nodes, are left out. Elsewhere, or
+// if the listing is unreadable, a single node holding every allowed CPU.
+struct NumaTopology {
+  struct Node {
+    size_t id;                 // the kernel's node number
+    std::vector<size_t> cpus;  // empty only on the fallback node
+  };
+
+  std::vector<Node> nodes;  // never empty
+
+  [[nodiscard]] static NumaTopology Detect() {
+    NumaTopology topology;
+#if defined(__linux__)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+      std::ifstream online("/sys/devices/system/node/online");
+      std::string text;
+      std::getline(online, text);
+      // node numbers are listed in the same format as CPUs
+      for (size_t id : ParseCpuList_(text)) {
+        std::ifstream list("/sys/devices/system/node/node" +
+                           std::to_string(id) + "/cpulist");
+        text.clear();
+        std::getline(list, text);
+        Node node{id, {}};
+        for (size_t cpu : ParseCpuList_(text)) {
+          if (cpu < static_cast<size_t>(CPU_SETSIZE) &&
+              CPU_ISSET(cpu, &allowed)) {
+            node.cpus.push_back(cpu);
+          }
+        }
+        if (!node.cpus.empty()) topology.nodes.push_back(std::move(node));
+      }
+    }
+#endif
+    if (topology.nodes.empty()) topology.nodes.push_back({0, {}});
+    return topology;
+  }
+
+  // A topology of |count| nodes that share every CPU, for spreading a
+  // structure over shards as if there were that many nodes.
+  [[nodiscard]] static NumaTopology Uniform(size_t count) {
+    NumaTopology topology;
+    for (size_t id = 0; id < count; id++) {
+      topology.nodes.push_back({id, {}});
+    }
+    return topology;
+  }
+
+  // Returns the index in |nodes| of the node whose CPU the calling thread is
+  // running on, or 0 if that is unknown.
+  [[nodiscard]] size_t CurrentNode() const {
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+    for (size_t i = 0; cpu >= 0 && i < nodes.size(); i++) {
+      for (size_t c : nodes[i].cpus) {
+        if (c == static_cast<size_t>(cpu)) return i;
+      }
+    }
+#endif
+    return 0;
+  }
+
+  // Restricts the calling thread to the CPUs of |nodes[index]|, so that the
+  // memory it first touches is allocated on that node under Linux's default
+  // local policy. Returns false where pinning is unsupported or fails, or the
+  // node lists no CPUs, leaving the thread as it was.
+  bool PinThisThreadToNode(size_t index) const {
+#if defined(__linux__)
+    if (index >= nodes.size() || nodes[index].cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t cpu : nodes[index].cpus) CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)index;
+    return false;
+#endif
+  }
+
+ private:
+  /**
+   * Returns the numbers in a list such as "0-3,8,10-11".
+   */
+  static std::vector<size_t> ParseCpuList_(const std::string& text) {
+    std::vector<size_t> cpus;
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t end = text.find(',', pos);
+      if (end == std::string::npos) end = text.size();
+      std::string range = text.substr(pos, end - pos);
+      size_t dash = range.find('-');
+      try {
+        size_t first = std::stoul(range.substr(0, dash));
+        size_t last = dash == std::string::npos
+                          ? first
+                          : std::stoul(range.substr(dash + 1));
+        for (size_t cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+      } catch (const std::exception&) {
+        // not a range; skip it
+      }
+      pos = end + 1;
+    }
+    return cpus;
+  }
+};
+
+#endif  // UTIL_NUMA_H
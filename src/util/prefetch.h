@@ -0,0 +1,38 @@
+#ifndef UTIL_PREFETCH_H
+#define UTIL_PREFETCH_H
+
+#include <cstddef>
+#include <memory>
+
+// Hints that the cache line holding |addr| will soon be read. Batch operations
+// issue this a few elements ahead so that bucket misses overlap.
+inline void PrefetchLine(const void* addr) { __builtin_prefetch(addr); }
+
+// How many elements ahead of the current one batch operations prefetch.
+inline constexpr size_t kPrefetchDistance = 8;
+
+// Hints that the elements of |bucket|, a contiguous container, will soon be
+// searched. Finding them reads the bucket itself, so that should have been
+// prefetched a while before.
+template <typename Bucket>
+void PrefetchElements(const Bucket& bucket) {
+  PrefetchLine(std::to_address(bucket.begin()));
+}
+
+// Prefetches ahead of element |i| of a batch of |n|, where |bucket_of(j)|
+// returns the bucket of element j: the bucket of element i +
+// 2 * kPrefetchDistance, and the elements of that of element i +
+// kPrefetchDistance, whose bucket was prefetched in the same way earlier. A
+// chained bucket only points to its elements, so asking for both at once
+// would stall on the bucket before the elements could be requested.
+template <typename BucketOf>
+void PrefetchAhead(size_t i, size_t n, BucketOf bucket_of) {
+  if (i + 2 * kPrefetchDistance < n) {
+    PrefetchLine(&bucket_of(i + 2 * kPrefetchDistance));
+  }
+  if (i + kPrefetchDistance < n) {
+    PrefetchElements(bucket_of(i + kPrefetchDistance));
+  }
+}
+
+#endif  // UTIL_PREFETCH_H
@@ -0,0 +1,258 @@
+#ifndef UTIL_RCU_BUCKET_H
+#define UTIL_RCU_BUCKET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "src/reclaim/epoch.h"
+#include "src/util/cache_line.h"
+#include "src/util/element_slot.h"
+
+// A bucket that readers may search without its lock while one writer at a
+// time, holding the lock, updates it (read-copy-update). The elements live in
+// a node behind an atomic pointer. An insertion constructs the new element
+// past the end of the node and then publishes the larger size, so readers
+// either see it whole or not at all; a removal, or an insertion into a full
+// node, publishes a modified copy instead, and retires the replaced node to
+// an EpochDomain. Elements are stored as SlotTraits<T> slots, so the callers
+// pass each element's hash along with it.
+//
+// Readers call Contains() while pinned in that domain; every other method
+// requires the bucket's lock. Nodes take their storage from |Allocator|,
+// rebound, and keep a copy of it to be freed with: the owner must call
+// Barrier() on the domain before destroying an arena that nodes came from.
+//
+// If |kPadded|, each bucket has a cache line to itself. Neighbouring buckets
+// are usually guarded by different locks, and a writer replacing one bucket's
+// node otherwise invalidates the line that writers and readers of up to seven
+// neighbours are using. Padding makes the bucket array eight times larger,
+// though, so it pays off only when many threads update a table whose buckets
+// stay in cache anyway.
+template <typename T, typename Allocator = std::allocator<T>,
+          bool kPadded = false>
+class alignas(kPadded ? kCacheLineSize : alignof(void*)) RcuBucket {
+ public:
+  using Slots = SlotTraits<T>;
+  using Slot = typename Slots::Slot;
+
+ private:
+  struct alignas(std::max(alignof(Slot), alignof(size_t))) Node {
+    std::atomic<size_t> size;
+    size_t capacity;
+    [[no_unique_address]] Allocator alloc;
+
+    Slot* slots() { return reinterpret_cast<Slot*>(this + 1); }
+    const Slot* slots() const {
+      return reinterpret_cast<const Slot*>(this + 1);
+    }
+  };
+
+  using NodeAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+ public:
+  using allocator_type = Allocator;
+
+  explicit RcuBucket(const Allocator& alloc) : alloc_(alloc) {}
+
+  RcuBucket(const RcuBucket& other) : alloc_(other.alloc_) {
+    for (const Slot& slot : other) PushBack(slot);
+  }
+
+  RcuBucket& operator=(const RcuBucket&) = delete;
+
+  ~RcuBucket() { Free_(node_.load(std::memory_order_relaxed)); }
+
+  // Returns true if the bucket holds |key|, whose hash is |hash|. Safe to call
+  // concurrently with the writer, inside a read-side section.
+  template <typename Key>
+  [[nodiscard]] bool Contains(const Key& key, size_t hash) const {
+    // seq_cst, as EpochDomain requires of loads by readers
+    const Node* node = node_.load();
+    if (node == nullptr) return false;
+    const Slot* slots = node->slots();
+    const Slot* end = slots + node->size.load(std::memory_order_acquire);
+    return Slots::Find(slots, end, key, hash) != end;
+  }
+
+  // Calls |fn| on every slot the bucket holds. Safe to call concurrently with
+  // the writer, inside a read-side section.
+  template <typename Fn>
+  void ReaderForEach(Fn fn) const {
+    // seq_cst, as in Contains()
+    const Node* node = node_.load();
+    if (node == nullptr) return;
+    const Slot* slots = node->slots();
+    size_t size = node->size.load(std::memory_order_acquire);
+    for (size_t i = 0; i < size; i++) fn(slots[i]);
+  }
+
+  // The slots the bucket holds now. Taken under the lock, the view stays
+  // valid, whatever writers do later, for as long as the caller remains
+  // pinned in the domain from before releasing the lock.
+  [[nodiscard]] std::span<const Slot> View() const { return {begin(), size()}; }
+
+  // Adds |elem|, whose hash is |hash|, unless it is already present, copying
+  // or moving it in only then. Retires the node it replaces if it has to
+  // grow.
+  template <typename U>
+  bool Add(U&& elem, size_t hash, EpochDomain& epoch) {
+    if (Slots::Find(begin(), end(), elem, hash) != end()) return false;
+
+    Node* node = node_.load(std::memory_order_relaxed);
+    if (size() < capacity()) {
+      // readers cannot see past the published size, so construct in place
+      std::construct_at(node->slots() + size(),
+                        Slots::Make(std::forward<U>(elem), hash));
+      node->size.store(size() + 1, std::memory_order_release);
+      return true;
+    }
+
+    Replace_(Grow_(Slots::Make(std::forward<U>(elem), hash)), epoch);
+    return true;
+  }
+
+  // Removes |key|, whose hash is |hash|, if present, publishing a copy of the
+  // node without it and retiring the original.
+  template <typename Key>
+  bool Remove(const Key& key, size_t hash, EpochDomain& epoch) {
+    const Slot* i = Slots::Find(begin(), end(), key, hash);
+    if (i == end()) return false;
+
+    Node* copy = nullptr;
+    if (size() > 1) {
+      copy = Allocate_(capacity());
+      for (const Slot* j = begin(); j != end(); j++) {
+        if (j != i) Construct_(copy, *j);
+      }
+    }
+    Replace_(copy, epoch);
+    return true;
+  }
+
+  // Adds |slot|, whose element must be absent, without regard for readers.
+  // Only for buckets that are not yet reachable by them.
+  void PushBack(Slot slot) {
+    Node* node = node_.load(std::memory_order_relaxed);
+    if (size() < capacity()) {
+      Construct_(node, std::move(slot));
+      return;
+    }
+    node_.store(Grow_(std::move(slot)), std::memory_order_relaxed);
+    Free_(node);
+  }
+
+  // Trims the node to the elements it holds, without regard for readers. Only
+  // for buckets that are not yet reachable by them.
+  void ShrinkToFit() {
+    Node* node = node_.load(std::memory_order_relaxed);
+    if (size() == capacity()) return;
+
+    Node* fitted = nullptr;
+    if (size() > 0) {
+      fitted = Allocate_(size());
+      for (const Slot& slot : *this) Construct_(fitted, slot);
+    }
+    node_.store(fitted, std::memory_order_relaxed);
+    Free_(node);
+  }
+
+  // The number of elements Contains() would search. Safe to call
+  // concurrently with the writer, inside a read-side section.
+  [[nodiscard]] size_t ReaderSize() const {
+    // seq_cst, as in Contains()
+    const Node* node = node_.load();
+    return node == nullptr ? 0 : node->size.load(std::memory_order_acquire);
+  }
+
+  [[nodiscard]] size_t size() const {
+    const Node* node = node_.load(std::memory_order_relaxed);
+    return node == nullptr ? 0 : node->size.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] size_t capacity() const {
+    const Node* node = node_.load(std::memory_order_relaxed);
+    return node == nullptr ? 0 : node->capacity;
+  }
+
+  [[nodiscard]] const Slot* begin() const {
+    const Node* node = node_.load(std::memory_order_relaxed);
+    return node == nullptr ? nullptr : node->slots();
+  }
+
+  [[nodiscard]] const Slot* end() const { return begin() + size(); }
+
+  [[nodiscard]] allocator_type get_allocator() const { return alloc_; }
+
+ private:
+  // the capacity of a bucket's first node; a bucket holds ~kMaxLoad elements
+  static constexpr size_t kMinCapacity = 4;
+
+  std::atomic<Node*> node_{nullptr};  // nullptr while empty
+  [[no_unique_address]] Allocator alloc_;
+
+  /**
+   * Returns the number of Node-sized units holding a node of |capacity|.
+   */
+  static size_t Units_(size_t capacity) {
+    return 1 + (capacity * sizeof(Slot) + sizeof(Node) - 1) / sizeof(Node);
+  }
+
+  Node* Allocate_(size_t capacity) {
+    NodeAllocator alloc(alloc_);
+    Node* node = std::allocator_traits<NodeAllocator>::allocate(
+        alloc, Units_(capacity));
+    node->size.store(0, std::memory_order_relaxed);
+    node->capacity = capacity;
+    std::construct_at(&node->alloc, alloc_);
+    return node;
+  }
+
+  static void Free_(Node* node) {
+    if (node == nullptr) return;
+    std::destroy_n(node->slots(), node->size.load(std::memory_order_relaxed));
+    NodeAllocator alloc(node->alloc);
+    std::destroy_at(&node->alloc);
+    std::allocator_traits<NodeAllocator>::deallocate(alloc, node,
+                                                     Units_(node->capacity));
+  }
+
+  /**
+   * Appends |slot| to an unpublished |node| with room for it.
+   */
+  static void Construct_(Node* node, Slot slot) {
+    size_t size = node->size.load(std::memory_order_relaxed);
+    assert(size < node->capacity);
+    std::construct_at(node->slots() + size, std::move(slot));
+    node->size.store(size + 1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns a copy of the current node with twice the capacity and |slot|
+   * appended.
+   */
+  Node* Grow_(Slot slot) {
+    Node* grown = Allocate_(std::max(kMinCapacity, 2 * capacity()));
+    for (const Slot& old : *this) Construct_(grown, old);
+    Construct_(grown, std::move(slot));
+    return grown;
+  }
+
+  /**
+   * Publishes |node| in place of the current node, which is freed once no
+   * reader can still hold it.
+   */
+  void Replace_(Node* node, EpochDomain& epoch) {
+    // seq_cst, as EpochDomain requires of unlinking stores
+    Node* old = node_.exchange(node);
+    if (old == nullptr) return;
+    epoch.Retire(old, [](void* p) { Free_(static_cast<Node*>(p)); });
+  }
+};
+
+#endif  // UTIL_RCU_BUCKET_H
@@ -0,0 +1,46 @@
+#ifndef UTIL_RESIZE_GATE_H
+#define UTIL_RESIZE_GATE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Elects a single thread to carry out each resize that a table's policy calls
+// for, so that threads which all see the policy fire at once do not each go on
+// to take exclusive ownership of the table only to find the work done.
+//
+// A thread evaluates the policy while holding a lock that keeps the table
+// stable, noting Generation() at the same time. After releasing that lock it
+// calls TryBegin() with the noted generation; only if that succeeds does it
+// take exclusive ownership, re-check the policy and resize, and it then calls
+// End(). Every rebuild of the table, whether through the gate or not, calls
+// Advance() while the table is exclusively owned, which turns away any thread
+// still holding a snapshot from before the rebuild.
+class ResizeGate {
+ public:
+  [[nodiscard]] size_t Generation() const {
+    return generation_.load(std::memory_order_relaxed);
+  }
+
+  // Returns true if no rebuild has happened since |generation| was noted and
+  // no other thread is already resizing through the gate. The caller must
+  // then call End().
+  bool TryBegin(size_t generation) {
+    if (generation_.load(std::memory_order_relaxed) != generation) {
+      return false;
+    }
+    bool idle = false;
+    return busy_.compare_exchange_strong(idle, true, std::memory_order_acquire,
+                                         std::memory_order_relaxed);
+  }
+
+  void End() { busy_.store(false, std::memory_order_release); }
+
+  // Records that the table has been rebuilt.
+  void Advance() { generation_.fetch_add(1, std::memory_order_relaxed); }
+
+ private:
+  std::atomic<size_t> generation_{0};
+  std::atomic<bool> busy_{false};
+};
+
+#endif  // UTIL_RESIZE_GATE_H
@@ -0,0 +1,254 @@
+#ifndef UTIL_SET_FILE_H
+#define UTIL_SET_FILE_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "src/util/cache_line.h"
+
+// The binary files that sets and tables are saved to, so that a restarted
+// process can reload a large set without adding its elements one at a time
+// through every resize. A file is a SetFileHeader followed by the payload, a
+// series of arrays of fixed-size records, each starting on a cache line:
+//   kKeys       - |count| elements, in any order, which the loader adds to a
+//                 table sized for them up front (see LoadHashSet());
+//   kFlatTable  - a FlatTable's control bytes and then its slots, as they are
+//                 in memory, which MappedFlatTable searches in place.
+// Records are stored as their bytes, so only trivially copyable types can be
+// saved, and a file reads back only on a machine of the same byte order and
+// type layout; the header's magic number and record size catch most
+// mismatches.
+enum class SetFileKind : uint32_t { kKeys = 1, kFlatTable = 2 };
+
+inline constexpr uint64_t kSetFileMagic = 0x454C494654455348;  // "HSETFILE"
+inline constexpr uint32_t kSetFileVersion = 1;
+
+struct SetFileHeader {
+  uint64_t magic = kSetFileMagic;
+  uint32_t version = kSetFileVersion;
+  SetFileKind kind = SetFileKind::kKeys;
+  uint32_t record_size = 0;  // sizeof of each element or slot
+  uint32_t group_width = 0;  // kFlatTable: the control group width probed
+  uint64_t count = 0;        // the number of elements
+  uint64_t slots = 0;        // kFlatTable: the slot count; kKeys: 0
+  // The hash of the first element, as its table computes it, or 0 if there
+  // is none. The hashers take no seed, so this stands in for one: a table
+  // image is only valid for a build whose hasher reproduces it.
+  uint64_t hash_check = 0;
+};
+
+static_assert(sizeof(SetFileHeader) <= kCacheLineSize);
+
+// Returns |offset| rounded up to the next cache line, where parts of the
+// payload start.
+inline size_t SetFileAlign(size_t offset) {
+  return (offset + kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize;
+}
+
+// Flushes |path|, a file or a directory, to stable storage. Does nothing
+// where there is no fsync(). Returns false, describing the failure in
+// |error|, if that fails.
+inline bool SyncSetFilePath(const std::string& path, std::string& error) {
+#if defined(__unix__) || defined(__APPLE__)
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || fsync(fd) != 0) {
+    error = "cannot sync " + path + ": " + std::strerror(errno);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  close(fd);
+#else
+  static_cast<void>(path);
+  static_cast<void>(error);
+#endif
+  return true;
+}
+
+// Writes |header| and then each of |parts| to |path|. The file is written
+// beside |path|, synced, renamed over it and its directory synced, so that
+// neither a crash nor a power loss leaves a truncated file in its place;
+// without fsync(), as off POSIX, only a process crash is covered. Returns
+// false, describing the failure in |error|, if any step fails.
+inline bool WriteSetFile(
+    const std::string& path, const SetFileHeader& header,
+    std::initializer_list<std::span<const std::byte>> parts,
+    std::string& error) {
+  std::string temp = path + ".tmp";
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    std::vector<char> padding(kCacheLineSize, 0);
+    size_t offset = sizeof(header);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (auto part : parts) {
+      auto pad = SetFileAlign(offset) - offset;
+      out.write(padding.data(), static_cast<std::streamsize>(pad));
+      out.write(reinterpret_cast<const char*>(part.data()),
+                static_cast<std::streamsize>(part.size()));
+      offset += pad + part.size();
+    }
+    out.flush();
+    if (!out) {
+      error = "cannot write " + temp;
+      std::remove(temp.c_str());
+      return false;
+    }
+  }
+  // the data must be durable before the rename makes it visible, or a power
+  // loss could leave the new name pointing at an empty file
+  if (!SyncSetFilePath(temp, error)) {
+    std::remove(temp.c_str());
+    return false;
+  }
+  if (std::rename(temp.c_str(), path.c_str()) != 0) {
+    error = "cannot rename " + temp + " to " + path + ": " +
+            std::strerror(errno);
+    std::remove(temp.c_str());
+    return false;
+  }
+  auto directory = std::filesystem::path(path).parent_path();
+  return SyncSetFilePath(directory.empty() ? "." : directory.string(), error);
+}
+
+// A set file mapped read-only into memory, whose payload is read in place.
+// Where mmap() is unavailable, the file is read into a buffer instead.
+class MappedSetFile {
+ public:
+  MappedSetFile() = default;
+
+  MappedSetFile(const MappedSetFile&) = delete;
+  MappedSetFile& operator=(const MappedSetFile&) = delete;
+
+  ~MappedSetFile() { Close_(); }
+
+  // Maps |path| and checks that it is a set file of |kind| whose records are
+  // |record_size| bytes, replacing any file mapped before. Returns false,
+  // describing the mismatch in |error|, otherwise.
+  bool Open(const std::string& path, SetFileKind kind, size_t record_size,
+            std::string& error) {
+    Close_();
+    if (!Map_(path, error)) return false;
+
+    if (size_ < sizeof(header_)) {
+      error = path + " is too short to be a set file";
+      return false;
+    }
+    std::memcpy(&header_, data_, sizeof(header_));
+    if (header_.magic != kSetFileMagic) {
+      error = path + " is not a set file, or has another byte order";
+    } else if (header_.version != kSetFileVersion) {
+      error = path + " has unsupported version " +
+              std::to_string(header_.version);
+    } else if (header_.kind != kind) {
+      error = path + " holds another kind of set file";
+    } else if (header_.record_size != record_size) {
+      error = path + " holds records of " +
+              std::to_string(header_.record_size) + " bytes, not " +
+              std::to_string(record_size);
+    } else {
+      offset_ = sizeof(header_);
+      return true;
+    }
+    return false;
+  }
+
+  [[nodiscard]] const SetFileHeader& Header() const { return header_; }
+
+  // Sets |part| to the next |n| records of the payload. Returns false,
+  // describing the failure in |error|, if the file ends before they do.
+  template <typename U>
+  bool Next(size_t n, std::span<const U>& part, std::string& error) {
+    size_t begin = SetFileAlign(offset_);
+    if (begin > size_ || n > (size_ - begin) / sizeof(U)) {
+      error = "set file is truncated";
+      return false;
+    }
+    part = {reinterpret_cast<const U*>(data_ + begin), n};
+    offset_ = begin + n * sizeof(U);
+    return true;
+  }
+
+ private:
+  const std::byte* data_ = nullptr;
+  size_t size_ = 0;
+  size_t offset_ = 0;  // where the part read last ends
+  SetFileHeader header_;
+#if !defined(__unix__) && !defined(__APPLE__)
+  std::vector<std::byte> buffer_;
+#endif
+
+  bool Map_(const std::string& path, std::string& error) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      error = "cannot open " + path + ": " + std::strerror(errno);
+      if (fd >= 0) close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ < sizeof(header_)) {
+      error = path + " is too short to be a set file";
+      close(fd);
+      size_ = 0;
+      return false;
+    }
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      error = "cannot map " + path + ": " + std::strerror(errno);
+      close(fd);
+      size_ = 0;
+      return false;
+    }
+    close(fd);  // the mapping keeps the file open
+    data_ = static_cast<const std::byte*>(data);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+      error = "cannot open " + path;
+      return false;
+    }
+    buffer_.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(buffer_.data()),
+            static_cast<std::streamsize>(buffer_.size()));
+    if (!in) {
+      error = "cannot read " + path;
+      return false;
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+    return true;
+  }
+
+  void Close_() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (data_ != nullptr) {
+      munmap(const_cast<std::byte*>(data_), size_);
+    }
+#else
+    buffer_.clear();
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    offset_ = 0;
+  }
+};
+
+#endif  // UTIL_SET_FILE_H
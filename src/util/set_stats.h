@@ -0,0 +1,290 @@
+#ifndef UTIL_SET_STATS_H
+#define UTIL_SET_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "src/util/cache_line.h"
+#include "src/util/thread_index.h"
+
+// Instrumentation of the hash sets, compiled in only when HASH_SET_STATS is
+// defined (the HASH_SET_STATS CMake option). Otherwise StatsRecorder is an
+// empty class whose methods do nothing, StatsMutex<M> is M itself, and the
+// sets report an empty SetStats, so the instrumented code costs nothing.
+#ifdef HASH_SET_STATS
+inline constexpr bool kCollectStats = true;
+#else
+inline constexpr bool kCollectStats = false;
+#endif
+
+// What a set's instrumentation has counted since it was constructed, as
+// returned by HashSetBase::Stats().
+struct SetStats {
+  // bucket_sizes[n] counts the searches of a bucket holding n elements, the
+  // most that such a search compares, as a hit stops early (in the lock-free
+  // set, the searches that walked n list nodes; in a FlatTable, that probed n
+  // groups); the last entry counts every larger bucket
+  static constexpr size_t kBucketSizes = 16;
+
+  // Per lock of the set's current locks, in index order: the times it was
+  // acquired, and the total time spent waiting for it when it was not free.
+  std::vector<uint64_t> lock_acquisitions;
+  std::vector<uint64_t> lock_wait_nanos;
+  // the same summed over every lock, including those of replaced lock arrays
+  uint64_t total_lock_acquisitions = 0;
+  uint64_t total_lock_wait_nanos = 0;
+
+  std::array<uint64_t, kBucketSizes> bucket_sizes{};
+  // the largest bucket searched, as counted by bucket_sizes
+  size_t max_bucket_size = 0;
+
+  // rehashes of the table, and their total duration
+  uint64_t resizes = 0;
+  uint64_t resize_nanos = 0;
+  // buckets that threads waiting on a rehash migrated for it
+  uint64_t helped_buckets = 0;
+
+  // Adds the counts of |other|, as of a set made of several, appending its
+  // locks after these.
+  SetStats& operator+=(const SetStats& other) {
+    lock_acquisitions.insert(lock_acquisitions.end(),
+                             other.lock_acquisitions.begin(),
+                             other.lock_acquisitions.end());
+    lock_wait_nanos.insert(lock_wait_nanos.end(),
+                           other.lock_wait_nanos.begin(),
+                           other.lock_wait_nanos.end());
+    total_lock_acquisitions += other.total_lock_acquisitions;
+    total_lock_wait_nanos += other.total_lock_wait_nanos;
+    for (size_t i = 0; i < kBucketSizes; i++) {
+      bucket_sizes[i] += other.bucket_sizes[i];
+    }
+    max_bucket_size = std::max(max_bucket_size, other.max_bucket_size);
+    resizes += other.resizes;
+    resize_nanos += other.resize_nanos;
+    helped_buckets += other.helped_buckets;
+    return *this;
+  }
+};
+
+#ifdef HASH_SET_STATS
+
+// Counts searches and resizes in per-thread shards, each on its own cache
+// line, so that recording adds no contention; Collect() sums the shards.
+class StatsRecorder {
+ public:
+  // Records a search of a bucket of |length| elements, or one that walked
+  // |length| nodes or probed |length| groups.
+  void RecordProbe(size_t length) {
+    auto& shard = Shard_();
+    Bump_(shard.probes[std::min(length, SetStats::kBucketSizes - 1)], 1);
+    size_t max = shard.max_chain.load(std::memory_order_relaxed);
+    while (length > max && !shard.max_chain.compare_exchange_weak(
+                               max, length, std::memory_order_relaxed)) {
+    }
+  }
+
+  // Records a search of |bucket| by its size. Buckets that lock-free
+  // readers search, such as RcuBucket, are sized as those readers see them.
+  template <typename Bucket>
+  void RecordSearch(const Bucket& bucket) {
+    if constexpr (requires { bucket.ReaderSize(); }) {
+      RecordProbe(bucket.ReaderSize());
+    } else {
+      RecordProbe(bucket.size());
+    }
+  }
+
+  // Bracket a resize. Resizes of one set never overlap, so the start time
+  // needs no sharding.
+  void BeginResize() { resize_began_ = std::chrono::steady_clock::now(); }
+
+  void EndResize() {
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - resize_began_)
+                     .count();
+    RecordResize(static_cast<uint64_t>(nanos));
+  }
+
+  void RecordResize(uint64_t nanos) {
+    auto& shard = Shard_();
+    Bump_(shard.resizes, 1);
+    Bump_(shard.resize_nanos, nanos);
+  }
+
+  // Keeps the counts of a lock array that is being replaced.
+  void RecordRetiredLocks(uint64_t acquisitions, uint64_t wait_nanos) {
+    auto& shard = Shard_();
+    Bump_(shard.lock_acquisitions, acquisitions);
+    Bump_(shard.lock_wait_nanos, wait_nanos);
+  }
+
+  // Adds every shard's counts to |stats|.
+  void Collect(SetStats& stats) const {
+    for (const auto& padded : shards_) {
+      const auto& shard = padded.value;
+      for (size_t i = 0; i < SetStats::kBucketSizes; i++) {
+        stats.bucket_sizes[i] +=
+            shard.probes[i].load(std::memory_order_relaxed);
+      }
+      stats.max_bucket_size =
+          std::max(stats.max_bucket_size,
+                   shard.max_chain.load(std::memory_order_relaxed));
+      stats.resizes += shard.resizes.load(std::memory_order_relaxed);
+      stats.resize_nanos += shard.resize_nanos.load(std::memory_order_relaxed);
+      stats.total_lock_acquisitions +=
+          shard.lock_acquisitions.load(std::memory_order_relaxed);
+      stats.total_lock_wait_nanos +=
+          shard.lock_wait_nanos.load(std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  static constexpr size_t kShards = 64;
+
+  struct Shard {
+    std::array<std::atomic<uint64_t>, SetStats::kBucketSizes> probes{};
+    std::atomic<size_t> max_chain{0};
+    std::atomic<uint64_t> resizes{0};
+    std::atomic<uint64_t> resize_nanos{0};
+    std::atomic<uint64_t> lock_acquisitions{0};
+    std::atomic<uint64_t> lock_wait_nanos{0};
+  };
+
+  std::array<CacheLinePadded<Shard>, kShards> shards_{};
+  std::chrono::steady_clock::time_point resize_began_;
+
+  Shard& Shard_() { return shards_[ThreadIndex() % kShards].value; }
+
+  /**
+   * Adds |n| to a counter that threads sharing its shard may also update.
+   */
+  static void Bump_(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+  }
+};
+
+// Wraps |Mutex|, counting acquisitions and the time spent waiting for it when
+// it was held. The counters share the mutex's cache line and are written only
+// by the thread that has just acquired it, so they add no contention; shared
+// acquisitions, which may run concurrently, update them atomically.
+template <typename Mutex>
+class CountingMutex {
+ public:
+  void lock() {
+    if (!mutex_.try_lock()) {
+      auto begin = std::chrono::steady_clock::now();
+      mutex_.lock();
+      Add_(wait_nanos_, Since_(begin));
+    }
+    Add_(acquisitions_, 1);
+  }
+
+  bool try_lock() {
+    if (!mutex_.try_lock()) return false;
+    Add_(acquisitions_, 1);
+    return true;
+  }
+
+  void unlock() { mutex_.unlock(); }
+
+  bool try_lock_shared()
+    requires requires(Mutex& m) { m.try_lock_shared(); }
+  {
+    if (!mutex_.try_lock_shared()) return false;
+    acquisitions_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void lock_shared()
+    requires requires(Mutex& m) { m.lock_shared(); }
+  {
+    if (!mutex_.try_lock_shared()) {
+      auto begin = std::chrono::steady_clock::now();
+      mutex_.lock_shared();
+      wait_nanos_.fetch_add(Since_(begin), std::memory_order_relaxed);
+    }
+    acquisitions_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void unlock_shared()
+    requires requires(Mutex& m) { m.unlock_shared(); }
+  {
+    mutex_.unlock_shared();
+  }
+
+  [[nodiscard]] uint64_t Acquisitions() const {
+    return acquisitions_.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] uint64_t WaitNanos() const {
+    return wait_nanos_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  Mutex mutex_;
+  std::atomic<uint64_t> acquisitions_{0};
+  std::atomic<uint64_t> wait_nanos_{0};
+
+  static uint64_t Since_(std::chrono::steady_clock::time_point begin) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin)
+            .count());
+  }
+
+  /**
+   * Adds to a counter while holding the mutex exclusively: no other writer can
+   * run, so a plain load and store suffice.
+   */
+  static void Add_(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+};
+
+template <typename Mutex>
+using StatsMutex = CountingMutex<Mutex>;
+
+// Appends the counts of every lock in |locks| to |stats|, where |Lock(l)|
+// returns the StatsMutex held by element |l|.
+template <typename Locks, typename Lock>
+void CollectLockStats(SetStats& stats, const Locks& locks, Lock lock) {
+  for (const auto& l : locks) {
+    const auto& mutex = lock(l);
+    stats.lock_acquisitions.push_back(mutex.Acquisitions());
+    stats.lock_wait_nanos.push_back(mutex.WaitNanos());
+    stats.total_lock_acquisitions += mutex.Acquisitions();
+    stats.total_lock_wait_nanos += mutex.WaitNanos();
+  }
+}
+
+#else  // !HASH_SET_STATS
+
+class StatsRecorder {
+ public:
+  void RecordProbe(size_t /*length*/) {}
+  template <typename Bucket>
+  void RecordSearch(const Bucket& /*bucket*/) {}
+  void BeginResize() {}
+  void EndResize() {}
+  void RecordResize(uint64_t /*nanos*/) {}
+  void RecordRetiredLocks(uint64_t /*acquisitions*/, uint64_t /*wait_nanos*/) {
+  }
+  void Collect(SetStats& /*stats*/) const {}
+};
+
+template <typename Mutex>
+using StatsMutex = Mutex;
+
+template <typename Locks, typename Lock>
+void CollectLockStats(SetStats& /*stats*/, const Locks& /*locks*/,
+                      Lock /*lock*/) {}
+
+#endif  // HASH_SET_STATS
+
+#endif  // UTIL_SET_STATS_H
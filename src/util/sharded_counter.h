@@ -0,0 +1,60 @@
+#ifndef UTIL_SHARDED_COUNTER_H
+#define UTIL_SHARDED_COUNTER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+#include "src/util/cache_line.h"
+#include "src/util/thread_index.h"
+
+// A counter spread over per-thread shards, each on its own cache line, so that
+// concurrent updates do not contend on a single shared line. Once a shard has
+// drifted by kBatch it is folded into a shared total, which keeps a cheap
+// approximate value available without summing every shard.
+class ShardedCounter {
+ public:
+  // Adds |delta| to the calling thread's shard.
+  void Add(ptrdiff_t delta) {
+    auto& shard = shards_[ThreadIndex() % kShards].value;
+    ptrdiff_t value = shard.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (value >= kBatch || value <= -kBatch) {
+      // threads sharing a shard may race here; exchange hands the drift to
+      // exactly one of them
+      total_.value.fetch_add(shard.exchange(0, std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+    }
+  }
+
+  void Increment() { Add(1); }
+
+  void Decrement() { Add(-1); }
+
+  // Returns the sum of every completed update, reading every shard. The value
+  // is exact whenever no update runs concurrently; callers that need a
+  // linearizable result must exclude updaters first.
+  [[nodiscard]] size_t Sum() const {
+    ptrdiff_t sum = total_.value.load(std::memory_order_relaxed);
+    for (const auto& shard : shards_) {
+      sum += shard.value.load(std::memory_order_relaxed);
+    }
+    return static_cast<size_t>(std::max<ptrdiff_t>(sum, 0));
+  }
+
+  // Returns the folded total, which lags the exact sum by fewer than
+  // kShards * kBatch updates, using a single load.
+  [[nodiscard]] size_t Approx() const {
+    return static_cast<size_t>(
+        std::max<ptrdiff_t>(total_.value.load(std::memory_order_relaxed), 0));
+  }
+
+ private:
+  static constexpr size_t kShards = 64;
+  static constexpr ptrdiff_t kBatch = 32;
+
+  std::array<CacheLinePadded<std::atomic<ptrdiff_t>>, kShards> shards_{};
+  CacheLinePadded<std::atomic<ptrdiff_t>> total_{};
+};
+
+#endif  // UTIL_SHARDED_COUNTER_H
@@ -0,0 +1,62 @@
+#ifndef UTIL_THREAD_INDEX_H
+#define UTIL_THREAD_INDEX_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Hands out thread indices, reusing those of threads that have exited so that
+// indices stay below the number of threads alive at once.
+class ThreadRegistry {
+ public:
+  static ThreadRegistry& Get() {
+    // leaked, so that threads exiting during static destruction can still
+    // give their indices back
+    static auto& registry = *new ThreadRegistry;
+    return registry;
+  }
+
+  size_t Register() {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    if (free_.empty()) return next_++;
+    size_t index = free_.back();
+    free_.pop_back();
+    return index;
+  }
+
+  void Unregister(size_t index) {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    free_.push_back(index);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<size_t> free_;
+  size_t next_ = 0;
+};
+
+// Returns a small integer unique among the threads currently alive, assigned
+// on the calling thread's first call and given back when it exits. Used to
+// pick a per-thread slot in sharded data structures.
+inline size_t ThreadIndex() {
+  struct Registration {
+    // the registry is never destroyed, so it outlives every registration
+    ThreadRegistry& registry = ThreadRegistry::Get();
+    size_t index = registry.Register();
+
+    ~Registration() { registry.Unregister(index); }
+  };
+  // The thread-exit hook that gives the index back, and the only object here
+  // with a destructor to run at exit.
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#endif
+  thread_local Registration registration;
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif
+  return registration.index;
+}
+
+#endif  // UTIL_THREAD_INDEX_H
@@ -0,0 +1,279 @@
+#include "src/workload.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace benchmark {
+
+namespace {
+
+// Parses all of |text| as a number, throwing std::invalid_argument otherwise.
+template <typename Number>
+Number ParseNumber(const std::string& text) {
+  size_t end = 0;
+  Number value;
+  if constexpr (std::is_floating_point_v<Number>) {
+    value = static_cast<Number>(std::stod(text, &end));
+  } else {
+    if (text.starts_with('-')) throw std::invalid_argument(text);
+    value = static_cast<Number>(std::stoull(text, &end));
+  }
+  if (end != text.size()) throw std::invalid_argument(text);
+  return value;
+}
+
+// Splits |text| at every |separator|.
+std::vector<std::string> Split(const std::string& text, char separator) {
+  std::vector<std::string> parts;
+  std::istringstream stream(text);
+  std::string part;
+  while (std::getline(stream, part, separator)) {
+    parts.push_back(part);
+  }
+  return parts;
+}
+
+bool ParseOption(const std::string& name, const std::string& value,
+                 Workload& workload, std::string& error) {
+  if (name == "mix") {
+    auto weights = Split(value, ':');
+    if (weights.size() != 3) {
+      error = "--mix expects three weights R:I:D";
+      return false;
+    }
+    workload.read_weight = ParseNumber<double>(weights[0]);
+    workload.insert_weight = ParseNumber<double>(weights[1]);
+    workload.remove_weight = ParseNumber<double>(weights[2]);
+  } else if (name == "keys") {
+    workload.key_range = ParseNumber<size_t>(value);
+  } else if (name == "prefill") {
+    workload.prefill = ParseNumber<size_t>(value);
+  } else if (name == "ops") {
+    workload.ops_per_thread = ParseNumber<size_t>(value);
+  } else if (name == "dist") {
+    if (value == "uniform") {
+      workload.distribution = KeyDistribution::kUniform;
+    } else if (value == "zipf") {
+      workload.distribution = KeyDistribution::kZipfian;
+    } else if (value == "hotspot") {
+      workload.distribution = KeyDistribution::kHotspot;
+    } else {
+      error = "--dist expects uniform, zipf or hotspot";
+      return false;
+    }
+  } else if (name == "theta") {
+    workload.zipf_theta = ParseNumber<double>(value);
+  } else if (name == "hot") {
+    auto fractions = Split(value, ':');
+    if (fractions.size() != 2) {
+      error = "--hot expects two fractions K:O";
+      return false;
+    }
+    workload.hot_key_fraction = ParseNumber<double>(fractions[0]);
+    workload.hot_op_fraction = ParseNumber<double>(fractions[1]);
+  } else if (name == "seed") {
+    workload.seed = ParseNumber<uint64_t>(value);
+  } else if (name == "sample") {
+    workload.latency_sample = ParseNumber<size_t>(value);
+  } else if (name == "pin") {
+    if (value != "0" && value != "1") {
+      error = "--pin expects 0 or 1";
+      return false;
+    }
+    workload.pin_threads = value == "1";
+  } else if (name == "format") {
+    if (value == "text") {
+      workload.format = ReportFormat::kText;
+    } else if (value == "csv") {
+      workload.format = ReportFormat::kCsv;
+    } else if (value == "json") {
+      workload.format = ReportFormat::kJson;
+    } else {
+      error = "--format expects text, csv or json";
+      return false;
+    }
+  } else {
+    error = "unknown option --" + name;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Checks the options that only make sense together.
+ */
+bool Validate(const Workload& workload, std::string& error) {
+  double weights[] = {workload.read_weight, workload.insert_weight,
+                      workload.remove_weight};
+  if (std::any_of(std::begin(weights), std::end(weights),
+                  [](double w) { return !(w >= 0); }) ||
+      workload.read_weight + workload.insert_weight + workload.remove_weight <=
+          0) {
+    error = "--mix weights must be non-negative, and not all zero";
+  } else if (workload.key_range == 0 ||
+             workload.key_range - 1 >
+                 static_cast<size_t>(std::numeric_limits<int>::max())) {
+    error = "--keys must be positive and fit the benchmark's int keys";
+  } else if (workload.prefill > workload.key_range) {
+    error = "--prefill cannot exceed --keys";
+  } else if (!(workload.zipf_theta > 0 && workload.zipf_theta < 1)) {
+    error = "--theta must lie in (0, 1)";
+  } else if (!(workload.hot_key_fraction > 0 &&
+               workload.hot_key_fraction <= 1) ||
+             !(workload.hot_op_fraction >= 0 &&
+               workload.hot_op_fraction <= 1)) {
+    error = "--hot fractions must lie in (0, 1] and [0, 1]";
+  } else {
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Returns sum_{i=1}^{n} 1 / i^theta.
+ */
+double Zeta(size_t n, double theta) {
+  double sum = 0;
+  for (size_t i = 1; i <= n; i++) {
+    sum += 1 / std::pow(static_cast<double>(i), theta);
+  }
+  return sum;
+}
+
+}  // namespace
+
+bool IsWorkloadOption(const char* arg) {
+  return std::strncmp(arg, "--", 2) == 0;
+}
+
+bool ParseWorkload(std::span<char* const> args, Workload& workload,
+                   std::string& error) {
+  bool prefill_given = false;
+  for (const char* arg : args) {
+    std::string option(arg);
+    size_t equals = option.find('=');
+    if (!IsWorkloadOption(arg) || equals == std::string::npos) {
+      error = "expected --name=value, got " + option;
+      return false;
+    }
+    std::string name = option.substr(2, equals - 2);
+    std::string value = option.substr(equals + 1);
+    prefill_given |= name == "prefill";
+    try {
+      if (!ParseOption(name, value, workload, error)) return false;
+    } catch (const std::logic_error&) {
+      // std::invalid_argument or std::out_of_range
+      error = "malformed value for --" + name + ": " + value;
+      return false;
+    }
+  }
+  if (!prefill_given) workload.prefill = workload.key_range / 2;
+  return Validate(workload, error);
+}
+
+std::string DescribeWorkload(const Workload& workload) {
+  std::ostringstream out;
+  out << "--mix=" << workload.read_weight << ':' << workload.insert_weight
+      << ':' << workload.remove_weight << " --keys=" << workload.key_range
+      << " --prefill=" << workload.prefill
+      << " --ops=" << workload.ops_per_thread;
+  switch (workload.distribution) {
+    case KeyDistribution::kUniform:
+      out << " --dist=uniform";
+      break;
+    case KeyDistribution::kZipfian:
+      out << " --dist=zipf --theta=" << workload.zipf_theta;
+      break;
+    case KeyDistribution::kHotspot:
+      out << " --dist=hotspot --hot=" << workload.hot_key_fraction << ':'
+          << workload.hot_op_fraction;
+      break;
+    default:
+      std::abort();
+  }
+  out << " --seed=" << workload.seed
+      << " --sample=" << workload.latency_sample
+      << " --pin=" << (workload.pin_threads ? 1 : 0);
+  return out.str();
+}
+
+KeyGenerator::KeyGenerator(const Workload& workload)
+    : distribution_(workload.distribution), key_range_(workload.key_range) {
+  if (distribution_ == KeyDistribution::kZipfian) {
+    theta_ = workload.zipf_theta;
+    zeta_n_ = Zeta(key_range_, theta_);
+    alpha_ = 1 / (1 - theta_);
+    // up to two keys, the first two ranks cover every draw
+    if (key_range_ > 2) {
+      double n = static_cast<double>(key_range_);
+      eta_ = (1 - std::pow(2 / n, 1 - theta_)) /
+             (1 - Zeta(2, theta_) / zeta_n_);
+    }
+  } else if (distribution_ == KeyDistribution::kHotspot) {
+    hot_keys_ = std::max<size_t>(
+        1, static_cast<size_t>(workload.hot_key_fraction *
+                               static_cast<double>(key_range_)));
+    hot_op_fraction_ = workload.hot_op_fraction;
+  }
+}
+
+size_t KeyGenerator::operator()(std::mt19937_64& rng) const {
+  switch (distribution_) {
+    case KeyDistribution::kZipfian:
+      return Zipfian_(rng);
+    case KeyDistribution::kHotspot:
+      return Hotspot_(rng);
+    case KeyDistribution::kUniform:
+      break;
+    default:
+      std::abort();
+  }
+  return std::uniform_int_distribution<size_t>(0, key_range_ - 1)(rng);
+}
+
+size_t KeyGenerator::Zipfian_(std::mt19937_64& rng) const {
+  double u = std::uniform_real_distribution<double>(0, 1)(rng);
+  double uz = u * zeta_n_;
+  if (uz < 1) return 0;
+  if (uz < 1 + std::pow(0.5, theta_)) {
+    return std::min<size_t>(1, key_range_ - 1);
+  }
+  double rank = static_cast<double>(key_range_) *
+                std::pow(eta_ * u - eta_ + 1, alpha_);
+  // rounding may land on the edge of the range
+  return std::min(static_cast<size_t>(rank), key_range_ - 1);
+}
+
+size_t KeyGenerator::Hotspot_(std::mt19937_64& rng) const {
+  bool hot = std::uniform_real_distribution<double>(0, 1)(rng) <
+                 hot_op_fraction_ ||
+             hot_keys_ == key_range_;
+  if (hot) {
+    return std::uniform_int_distribution<size_t>(0, hot_keys_ - 1)(rng);
+  }
+  return std::uniform_int_distribution<size_t>(hot_keys_, key_range_ - 1)(rng);
+}
+
+WorkloadResult& WorkloadResult::operator+=(const WorkloadResult& other) {
+  reads += other.reads;
+  hits += other.hits;
+  inserts += other.inserts;
+  inserted += other.inserted;
+  removes += other.removes;
+  removed += other.removed;
+  seconds = std::max(seconds, other.seconds);
+  read_latency += other.read_latency;
+  insert_latency += other.insert_latency;
+  remove_latency += other.remove_latency;
+  return *this;
+}
+
+}  // namespace benchmark
@@ -0,0 +1,186 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+
+#include "src/hash_set_base.h"
+#include "src/latency_histogram.h"
+
+namespace benchmark {
+
+enum class KeyDistribution { kUniform, kZipfian, kHotspot };
+
+enum class ReportFormat { kText, kCsv, kJson };
+
+// A mix of lookups, insertions and removals over the keys [0, key_range),
+// which every thread draws from the same distribution. Options are given on
+// the command line as --name=value:
+//
+//   --mix=R:I:D       relative weights of Contains, Add and Remove
+//   --keys=N          the key range
+//   --prefill=N       distinct keys added, spread evenly, before timing starts;
+//                     half the key range by default
+//   --ops=N           operations per thread
+//   --dist=uniform|zipf|hotspot
+//   --theta=X         Zipfian skew, in (0, 1); key k has rank k
+//   --hot=K:O         hotspot: a fraction O of operations go to the first
+//                     fraction K of keys
+//   --seed=N          thread i seeds its generator with N + i
+//
+// and for how the run is measured and reported:
+//
+//   --sample=N        time one operation in N for the latency histograms, or
+//                     none if 0
+//   --format=text|csv|json
+//   --pin=0|1         pin thread i to the ith CPU available, where supported
+struct Workload {
+  double read_weight = 90;
+  double insert_weight = 5;
+  double remove_weight = 5;
+  KeyDistribution distribution = KeyDistribution::kUniform;
+  size_t key_range = size_t{1} << 20;
+  size_t prefill = size_t{1} << 19;
+  size_t ops_per_thread = 1000000;
+  double zipf_theta = 0.99;
+  double hot_key_fraction = 0.2;
+  double hot_op_fraction = 0.8;
+  uint64_t seed = 1;
+  size_t latency_sample = 16;
+  ReportFormat format = ReportFormat::kText;
+  bool pin_threads = false;
+};
+
+// Returns true if |arg| looks like a workload option rather than a positional
+// argument.
+bool IsWorkloadOption(const char* arg);
+
+// Applies |args| over the defaults in |workload|. On a malformed or
+// inconsistent option, returns false and describes it in |error|.
+bool ParseWorkload(std::span<char* const> args, Workload& workload,
+                   std::string& error);
+
+// Returns the options that reproduce |workload|, for the benchmark's output.
+std::string DescribeWorkload(const Workload& workload);
+
+// Draws keys from a workload's distribution. Immutable once constructed, so
+// threads share one generator and each pass their own random engine.
+class KeyGenerator {
+ public:
+  // Precomputes the Zipfian constants, which takes time linear in the range.
+  explicit KeyGenerator(const Workload& workload);
+
+  size_t operator()(std::mt19937_64& rng) const;
+
+ private:
+  KeyDistribution distribution_;
+  size_t key_range_;
+  // Zipfian, after Gray et al., "Quickly generating billion-record synthetic
+  // databases" (as in YCSB)
+  double theta_ = 0;
+  double zeta_n_ = 0;
+  double alpha_ = 0;
+  double eta_ = 0;
+  // hotspot
+  size_t hot_keys_ = 0;
+  double hot_op_fraction_ = 0;
+
+  size_t Zipfian_(std::mt19937_64& rng) const;
+  size_t Hotspot_(std::mt19937_64& rng) const;
+};
+
+// What one thread did during a workload; successful updates are counted
+// separately so the final size of the set can be checked. The histograms hold
+// the sampled latencies of each type of operation.
+struct WorkloadResult {
+  size_t reads = 0;
+  size_t hits = 0;
+  size_t inserts = 0;
+  size_t inserted = 0;
+  size_t removes = 0;
+  size_t removed = 0;
+  // the thread's own running time, from its start to its last operation
+  double seconds = 0;
+  LatencyHistogram read_latency;
+  LatencyHistogram insert_latency;
+  LatencyHistogram remove_latency;
+
+  [[nodiscard]] size_t Ops() const { return reads + inserts + removes; }
+
+  // Sums the counts and merges the histograms; the seconds become the
+  // longest of the two.
+  WorkloadResult& operator+=(const WorkloadResult& other);
+};
+
+// Adds |workload.prefill| distinct keys, spread evenly over the key range.
+template <HashSet<int> HashSetType>
+void Prefill(HashSetType& hash_set, const Workload& workload) {
+  for (size_t i = 0; i < workload.prefill; i++) {
+    // distinct, since the range is at least as large as the prefill
+    hash_set.Add(static_cast<int>(i * workload.key_range / workload.prefill));
+  }
+}
+
+// Runs thread |id|'s share of |workload| on |hash_set|. A template, so that
+// the set's calls bind statically and inline into the loop.
+template <HashSet<int> HashSetType>
+void WorkloadThreadBody(HashSetType& hash_set, const Workload& workload,
+                        const KeyGenerator& keys, size_t id,
+                        WorkloadResult& result) {
+  using Clock = std::chrono::steady_clock;
+
+  result = WorkloadResult{};
+  std::mt19937_64 rng(workload.seed + id);
+  std::uniform_real_distribution<double> pick(0, workload.read_weight +
+                                                     workload.insert_weight +
+                                                     workload.remove_weight);
+  double insert_threshold = workload.read_weight + workload.insert_weight;
+
+  // times |op| if this is a sampled operation, and returns its result
+  auto run = [&](size_t k, LatencyHistogram& latency, auto op) {
+    if (workload.latency_sample == 0 || k % workload.latency_sample != 0) {
+      return op();
+    }
+    auto begin = Clock::now();
+    bool found = op();
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     Clock::now() - begin)
+                     .count();
+    latency.Record(static_cast<uint64_t>(nanos));
+    return found;
+  };
+
+  auto begin_time = Clock::now();
+  for (size_t k = 0; k < workload.ops_per_thread; k++) {
+    double op = pick(rng);
+    int elem = static_cast<int>(keys(rng));
+    if (op < workload.read_weight) {
+      result.reads++;
+      if (run(k, result.read_latency,
+              [&] { return hash_set.Contains(elem); })) {
+        result.hits++;
+      }
+    } else if (op < insert_threshold) {
+      result.inserts++;
+      if (run(k, result.insert_latency, [&] { return hash_set.Add(elem); })) {
+        result.inserted++;
+      }
+    } else {
+      result.removes++;
+      if (run(k, result.remove_latency,
+              [&] { return hash_set.Remove(elem); })) {
+        result.removed++;
+      }
+    }
+  }
+  result.seconds = std::chrono::duration<double>(Clock::now() - begin_time)
+                       .count();
+}
+
+}  // namespace benchmark
+
+#endif  // WORKLOAD_H